@@ -0,0 +1,79 @@
+#include "blackgdk.h"
+
+const unsigned long int REPEATS=2000;
+
+void draw_per_pixel(BLACKGDK::Offscreen &screen,BLACKGDK::Canvas &canvas,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+{
+ unsigned long int step_x,step_y;
+ size_t offset,pixels;
+ unsigned int *target;
+ const unsigned int *image;
+ target=screen.get_buffer();
+ image=canvas.get_image();
+ pixels=static_cast<size_t>(screen.get_frame_stride())*static_cast<size_t>(screen.get_frame_height());
+ for (step_y=0;step_y<height;++step_y)
+ {
+  for (step_x=0;step_x<width;++step_x)
+  {
+   offset=static_cast<size_t>(x+step_x)+static_cast<size_t>(y+step_y)*static_cast<size_t>(screen.get_frame_stride());
+   if (offset<pixels) target[offset]=image[static_cast<size_t>(step_x)+static_cast<size_t>(step_y)*static_cast<size_t>(canvas.get_image_width())];
+  }
+
+ }
+
+}
+
+void show_result(const char *name,const unsigned long long int pixel_time,const unsigned long long int span_time)
+{
+ printf("%-12s per pixel %8.2f us  row spans %8.2f us  speedup %6.1fx\n",name,static_cast<double>(pixel_time)/REPEATS/1000.0,static_cast<double>(span_time)/REPEATS/1000.0,static_cast<double>(pixel_time)/static_cast<double>(span_time));
+}
+
+int main()
+{
+ unsigned long int index;
+ unsigned long long int start,pixel_time,span_time;
+ BLACKGDK::Clock clock;
+ BLACKGDK::Offscreen screen;
+ BLACKGDK::Image image;
+ BLACKGDK::Sprite ship;
+ BLACKGDK::Background space;
+ screen.initialize();
+ ship.initialize(screen.get_handle());
+ space.initialize(screen.get_handle());
+ image.load_tga("ship.tga");
+ ship.load_sprite(image,HORIZONTAL_STRIP,2);
+ ship.set_transparent(false);
+ image.load_tga("space.tga");
+ space.load_image(image);
+ space.resize_image(screen.get_frame_width(),screen.get_frame_height(),BILINEAR_FILTER);
+ space.set_kind(NORMAL_BACKGROUND);
+ start=clock.get_time();
+ for (index=0;index<REPEATS;++index)
+ {
+  draw_per_pixel(screen,ship,index%256,index%192,ship.get_width(),ship.get_height());
+ }
+ pixel_time=clock.get_time()-start;
+ start=clock.get_time();
+ for (index=0;index<REPEATS;++index)
+ {
+  ship.draw_sprite(index%256,index%192);
+ }
+ screen.flush();
+ span_time=clock.get_time()-start;
+ show_result("sprite",pixel_time,span_time);
+ start=clock.get_time();
+ for (index=0;index<REPEATS;++index)
+ {
+  draw_per_pixel(screen,space,0,0,screen.get_frame_width(),screen.get_frame_height());
+ }
+ pixel_time=clock.get_time()-start;
+ start=clock.get_time();
+ for (index=0;index<REPEATS;++index)
+ {
+  space.draw_background();
+ }
+ screen.flush();
+ span_time=clock.get_time()-start;
+ show_result("background",pixel_time,span_time);
+ return 0;
+}
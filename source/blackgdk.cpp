@@ -78,1850 +78,6420 @@ void Halt(const char *message)
  exit(EXIT_FAILURE);
 }
 
- COM_Base::COM_Base()
+void *allocate_aligned(const size_t size,const size_t alignment)
 {
- HRESULT status;
- status=CoInitializeEx(NULL,COINIT_APARTMENTTHREADED);
- if (status!=S_OK)
+ unsigned char *memory;
+ unsigned char *result;
+ result=NULL;
+ memory=static_cast<unsigned char*>(malloc(size+alignment+sizeof(void*)));
+ if (memory!=NULL)
  {
-  if (status!=S_FALSE)
-  {
-   Halt("Can't initialize COM");
-  }
-
+  result=memory+sizeof(void*);
+  result+=(alignment-reinterpret_cast<size_t>(result)%alignment)%alignment;
+  reinterpret_cast<void**>(result)[-1]=memory;
  }
-
+ return result;
 }
 
-COM_Base::~COM_Base()
+void free_aligned(void *target)
 {
- CoUninitialize();
+ if (target!=NULL) free(static_cast<void**>(target)[-1]);
 }
 
-Synchronization::Synchronization()
+IMAGE_FORMAT get_image_format(const char *name)
 {
- timer=NULL;
+ IMAGE_FORMAT result;
+ size_t length;
+ result=TGA_IMAGE;
+ length=strlen(name);
+ if (length>4)
+ {
+  if ((name[length-4]=='.')&&((name[length-3]=='p')||(name[length-3]=='P'))&&((name[length-2]=='c')||(name[length-2]=='C'))&&((name[length-1]=='x')||(name[length-1]=='X'))) result=PCX_IMAGE;
+ }
+ return result;
 }
 
-Synchronization::~Synchronization()
+void draw_transparent_span(unsigned int *target,const unsigned int *source,const size_t length,const unsigned int key)
 {
- if (timer!=NULL)
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  CancelWaitableTimer(timer);
-  CloseHandle(timer);
+  if (source[index]!=key) target[index]=source[index];
  }
 
 }
 
-void Synchronization::create_timer()
+#ifdef BLACKGDK_SSE2
+SSE2_CODE void draw_transparent_span_sse2(unsigned int *target,const unsigned int *source,const size_t length,const unsigned int key)
 {
- timer=CreateWaitableTimer(NULL,FALSE,NULL);
- if (timer==NULL)
+ size_t index,stop;
+ __m128i pixels,mask,background,color;
+ color=_mm_set1_epi32(static_cast<int>(key));
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
  {
-  Halt("Can't create synchronization timer");
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  mask=_mm_cmpeq_epi32(pixels,color);
+  if (_mm_movemask_epi8(mask)!=0xFFFF)
+  {
+   background=_mm_loadu_si128(reinterpret_cast<const __m128i*>(target+index));
+   pixels=_mm_or_si128(_mm_and_si128(mask,background),_mm_andnot_si128(mask,pixels));
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(target+index),pixels);
+  }
+
  }
+ draw_transparent_span(target+stop,source+stop,length-stop,key);
+}
+#endif
+
+unsigned int divide_color(const unsigned int value)
+{
+ return (value+128+((value+128)>>8))>>8;
+}
 
+void copy_span(unsigned int *target,const unsigned int *source,const size_t length)
+{
+ memcpy(target,source,length*sizeof(unsigned int));
 }
 
-void Synchronization::set_timer(const unsigned long int interval)
+void blend_normal_span(unsigned int *target,const unsigned int *source,const size_t length)
 {
- LARGE_INTEGER start;
- start.QuadPart=0;
- if (SetWaitableTimer(timer,&start,interval,NULL,NULL,FALSE)==FALSE)
+ size_t index;
+ unsigned int shift,alpha,channel,result;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't set timer");
+  alpha=255-(source[index]>>24);
+  result=0;
+  for (shift=0;shift<32;shift+=8)
+  {
+   channel=((source[index]>>shift)&255)+divide_color(((target[index]>>shift)&255)*alpha);
+   if (channel>255) channel=255;
+   result|=channel<<shift;
+  }
+  target[index]=result;
  }
 
 }
 
-void Synchronization::wait_timer()
+void blend_additive_span(unsigned int *target,const unsigned int *source,const size_t length)
 {
- WaitForSingleObjectEx(timer,INFINITE,TRUE);
-}
+ size_t index;
+ unsigned int shift,channel,result;
+ for (index=0;index<length;++index)
+ {
+  result=0;
+  for (shift=0;shift<32;shift+=8)
+  {
+   channel=((source[index]>>shift)&255)+((target[index]>>shift)&255);
+   if (channel>255) channel=255;
+   result|=channel<<shift;
+  }
+  target[index]=result;
+ }
 
-Engine::Engine()
-{
- window_class.lpszClassName=TEXT("BLACKGDK");
- window_class.style=CS_HREDRAW|CS_VREDRAW;
- window_class.cbSize=sizeof(WNDCLASSEX);
- window_class.lpfnWndProc=Process_Message;
- window_class.hInstance=NULL;
- window_class.hbrBackground=NULL;
- window_class.hIcon=NULL;
- window_class.hCursor=NULL;
- window_class.hIconSm=NULL;
- window_class.cbClsExtra=0;
- window_class.cbWndExtra=0;
- window=NULL;
 }
 
-Engine::~Engine()
+void blend_multiply_span(unsigned int *target,const unsigned int *source,const size_t length)
 {
- if (window!=NULL) CloseWindow(window);
- UnregisterClass(window_class.lpszClassName,window_class.hInstance);
+ size_t index;
+ unsigned int shift,alpha,background,channel,result;
+ for (index=0;index<length;++index)
+ {
+  alpha=255-(source[index]>>24);
+  result=0;
+  for (shift=0;shift<32;shift+=8)
+  {
+   background=(target[index]>>shift)&255;
+   channel=divide_color(((source[index]>>shift)&255)*background)+divide_color(background*alpha);
+   if (channel>255) channel=255;
+   result|=channel<<shift;
+  }
+  target[index]=result;
+ }
+
 }
 
-void Engine::get_instance()
+void scale_span(unsigned int *target,const unsigned int *source,const unsigned long int *columns,const size_t length)
 {
- if (GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,NULL,&window_class.hInstance)==FALSE)
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't get the application instance");
+  target[index]=source[columns[index]];
  }
 
 }
 
-void Engine::load_icon()
+void double_span(unsigned int *target,const unsigned int *source,const size_t length)
 {
- window_class.hIcon=LoadIcon(NULL,IDI_APPLICATION);
- if (window_class.hIcon==NULL)
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't load the standart program icon");
+  target[0]=source[index];
+  target[1]=source[index];
+  target+=2;
  }
 
 }
 
-void Engine::load_cursor()
+void triple_span(unsigned int *target,const unsigned int *source,const size_t length)
 {
- window_class.hCursor=LoadCursor(NULL,IDC_ARROW);
- if (window_class.hCursor==NULL)
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't load the standart cursor");
+  target[0]=source[index];
+  target[1]=source[index];
+  target[2]=source[index];
+  target+=3;
  }
 
 }
 
-void Engine::register_window_class()
+void quadruple_span(unsigned int *target,const unsigned int *source,const size_t length)
 {
- if (!RegisterClassEx(&window_class))
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't register window class");
+  target[0]=source[index];
+  target[1]=source[index];
+  target[2]=source[index];
+  target[3]=source[index];
+  target+=4;
  }
 
 }
 
-HWND Engine::get_window()
+unsigned int mix_pixels(const unsigned int first,const unsigned int second,const unsigned int weight)
 {
- return window;
+ unsigned int shift,result;
+ result=0;
+ for (shift=0;shift<32;shift+=8)
+ {
+  result|=((((first>>shift)&255)*(256-weight)+((second>>shift)&255)*weight+128)>>8)<<shift;
+ }
+ return result;
 }
 
-void Engine::prepare_engine()
+void mix_span(unsigned int *target,const unsigned int *first,const unsigned int *second,const size_t length,const unsigned int weight)
 {
- this->get_instance();
- this->load_icon();
- this->load_cursor();
- this->register_window_class();
+ size_t index;
+ for (index=0;index<length;++index)
+ {
+  target[index]=mix_pixels(first[index],second[index],weight);
+ }
+
 }
 
-void Engine::create_window()
+void interpolate_span(unsigned int *target,const unsigned int *source,const unsigned long int *columns,const unsigned long int *weights,const size_t length)
 {
- window=CreateWindowEx(WS_EX_APPWINDOW,window_class.lpszClassName,NULL,WS_VISIBLE|WS_POPUP,0,0,GetSystemMetrics(SM_CXSCREEN),GetSystemMetrics(SM_CYSCREEN),NULL,NULL,window_class.hInstance,NULL);
- if (window==NULL)
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't create window");
+  target[index]=mix_pixels(source[columns[index]],source[columns[index]+1],weights[index]);
  }
- SetFocus(window);
+
 }
 
-void Engine::capture_mouse()
+void accumulate_span(unsigned int *sum,const unsigned int *source,const size_t length)
 {
- RECT border;
- if (GetClientRect(window,&border)==FALSE)
+ size_t index;
+ for (index=0;index<length;++index)
  {
-  Halt("Can't capture window");
+  sum[0]+=source[index]&255;
+  sum[1]+=(source[index]>>8)&255;
+  sum[2]+=(source[index]>>16)&255;
+  sum[3]+=source[index]>>24;
+  sum+=4;
  }
- if (ClipCursor(&border)==FALSE)
+
+}
+
+void epx_span(unsigned int *first_line,unsigned int *second_line,const unsigned int *up,const unsigned int *row,const unsigned int *down,const size_t start,const size_t stop,const size_t width)
+{
+ size_t index,left,right;
+ unsigned int a,b,c,d,p;
+ for (index=start;index<stop;++index)
  {
-  Halt("Can't capture cursor");
+  left=index;
+  right=index;
+  if (index>0) left=index-1;
+  if (index+1<width) right=index+1;
+  p=row[index];
+  a=up[index];
+  b=row[right];
+  c=row[left];
+  d=down[index];
+  first_line[2*index]=p;
+  first_line[2*index+1]=p;
+  second_line[2*index]=p;
+  second_line[2*index+1]=p;
+  if ((c==a)&&(c!=d)&&(a!=b)) first_line[2*index]=a;
+  if ((a==b)&&(a!=c)&&(b!=d)) first_line[2*index+1]=b;
+  if ((d==c)&&(d!=b)&&(c!=a)) second_line[2*index]=c;
+  if ((b==d)&&(b!=a)&&(d!=c)) second_line[2*index+1]=d;
  }
 
 }
 
-bool Engine::process_message()
+void epx_line(unsigned int *first_line,unsigned int *second_line,const unsigned int *up,const unsigned int *row,const unsigned int *down,const size_t width)
 {
- bool run;
- MSG Message;
- run=true;
- while(PeekMessage(&Message,window,0,0,PM_NOREMOVE)==TRUE)
+ epx_span(first_line,second_line,up,row,down,0,width,width);
+}
+
+int compare_commands(const void *first,const void *second)
+{
+ const Draw_Command *left;
+ const Draw_Command *right;
+ int result;
+ left=static_cast<const Draw_Command*>(first);
+ right=static_cast<const Draw_Command*>(second);
+ result=0;
+ if (left->order<right->order) result=-1;
+ if (left->order>right->order) result=1;
+ if (left->image<right->image) result=-1;
+ if (left->image>right->image) result=1;
+ if (left->layer<right->layer) result=-1;
+ if (left->layer>right->layer) result=1;
+ return result;
+}
+
+void convert_image(unsigned int *target,const unsigned char *source,const size_t length,const unsigned long int depth)
+{
+ size_t index;
+ unsigned int alpha;
+ if (depth==32)
  {
-  if (GetMessage(&Message,window,0,0)==TRUE)
+  for (index=0;index<length;++index)
   {
-   TranslateMessage(&Message);
-   DispatchMessage(&Message);
+   alpha=source[3];
+   target[index]=divide_color(source[0]*alpha)+(divide_color(source[1]*alpha)<<8)+(divide_color(source[2]*alpha)<<16)+(alpha<<24);
+   source+=4;
   }
-  else
+
+ }
+ else
+ {
+  for (index=0;index<length;++index)
   {
-   run=false;
-   break;
+   target[index]=static_cast<unsigned int>(source[0])+(static_cast<unsigned int>(source[1])<<8)+(static_cast<unsigned int>(source[2])<<16)+0xFF000000;
+   source+=3;
   }
 
  }
- return run;
-}
 
-unsigned long int Engine::get_width()
-{
- return GetSystemMetrics(SM_CXSCREEN);
 }
 
-unsigned long int Engine::get_height()
+unsigned int hash_name(const char *name,const size_t length)
 {
- return GetSystemMetrics(SM_CYSCREEN);
+ size_t index;
+ unsigned int result;
+ result=2166136261U;
+ for (index=0;index<length;++index)
+ {
+  result^=static_cast<unsigned char>(name[index]);
+  result*=16777619U;
+ }
+ return result;
 }
 
-Frame::Frame()
+unsigned long long int hash_pixels(const unsigned int *pixels,const size_t length)
 {
- frame_width=512;
- frame_height=512;
- frame_line=0;
- pixels=0;
- buffer=NULL;
- shadow=NULL;
+ size_t index;
+ unsigned long long int result;
+ result=14695981039346656037ULL;
+ for (index=0;index<length;++index)
+ {
+  result^=pixels[index];
+  result*=1099511628211ULL;
+ }
+ return result;
 }
 
-Frame::~Frame()
+Pixel_Storage *create_storage(unsigned int *pixels,const unsigned long int width,const unsigned long int height)
 {
- if (buffer!=NULL)
+ Pixel_Storage *target;
+ target=NULL;
+ try
  {
-  delete[] buffer;
-  buffer=NULL;
+  target=new Pixel_Storage;
  }
- if (shadow!=NULL)
+ catch (...)
  {
-  delete[] shadow;
-  shadow=NULL;
+  Halt("Can't allocate memory for pixel storage");
  }
-
+ target->references=1;
+ target->width=width;
+ target->height=height;
+ target->pixels=pixels;
+ return target;
 }
 
-void Frame::calculate_buffer_length()
+void retain_storage(Pixel_Storage *target)
 {
- pixels=static_cast<size_t>(frame_width)*static_cast<size_t>(frame_height);
- frame_line=frame_width*static_cast<unsigned long int>(sizeof(unsigned int));
+ InterlockedIncrement(&target->references);
 }
 
-unsigned int *Frame::get_memory(const char *error)
+Frame_Link *create_link(Frame *frame)
 {
- unsigned int *target;
+ Frame_Link *target;
  target=NULL;
  try
  {
-  target=new unsigned int[pixels];
+  target=new Frame_Link;
  }
  catch (...)
  {
-  Halt(error);
+  Halt("Can't allocate memory for frame link");
  }
+ target->references=1;
+ target->frame=frame;
  return target;
 }
 
-void Frame::clear_buffer(unsigned int *target)
+void release_link(Frame_Link *target)
 {
- size_t index;
- for (index=0;index<pixels;++index)
+ if (InterlockedDecrement(&target->references)==0) delete target;
+}
+
+void release_storage(Pixel_Storage *target)
+{
+ if (InterlockedDecrement(&target->references)==0)
  {
-  target[index]=0;
+  free_aligned(target->pixels);
+  delete target;
  }
 
 }
 
-unsigned int *Frame::create_buffer(const char *error)
+void merge_planes(unsigned char *target,const unsigned char *red,const unsigned char *green,const unsigned char *blue,const size_t length)
 {
- unsigned int *target;
- target=NULL;
- this->calculate_buffer_length();
- target=this->get_memory(error);
- this->clear_buffer(target);
- return target;
+ size_t index;
+ for (index=0;index<length;++index)
+ {
+  target[0]=blue[index];
+  target[1]=green[index];
+  target[2]=red[index];
+  target+=3;
+ }
+
 }
 
-size_t Frame::get_offset(const unsigned long int x,const unsigned long int y,const unsigned long int target_width)
+#ifdef BLACKGDK_SSE2
+SSE2_CODE void store_packed_sse2(unsigned char *target,const __m128i pixels)
 {
- return static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(target_width);
+ int tail;
+ __m128i packed;
+ packed=_mm_or_si128(_mm_and_si128(pixels,_mm_set_epi32(0,0x00FFFFFF,0,0x00FFFFFF)),_mm_and_si128(_mm_srli_epi64(pixels,8),_mm_set_epi32(0x0000FFFF,static_cast<int>(0xFF000000),0x0000FFFF,static_cast<int>(0xFF000000))));
+ packed=_mm_or_si128(_mm_and_si128(packed,_mm_set_epi32(0,0,0x0000FFFF,-1)),_mm_and_si128(_mm_srli_si128(packed,2),_mm_set_epi32(0,-1,static_cast<int>(0xFFFF0000),0)));
+ _mm_storel_epi64(reinterpret_cast<__m128i*>(target),packed);
+ tail=_mm_cvtsi128_si32(_mm_srli_si128(packed,8));
+ memcpy(target+8,&tail,4);
 }
 
-size_t Frame::get_offset(const unsigned long int x,const unsigned long int y) const
+SSE2_CODE void merge_planes_sse2(unsigned char *target,const unsigned char *red,const unsigned char *green,const unsigned char *blue,const size_t length)
 {
- return static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(frame_width);
+ size_t index,stop;
+ __m128i zero,low,high,first,second;
+ zero=_mm_setzero_si128();
+ stop=length-length%16;
+ for (index=0;index<stop;index+=16)
+ {
+  first=_mm_loadu_si128(reinterpret_cast<const __m128i*>(blue+index));
+  second=_mm_loadu_si128(reinterpret_cast<const __m128i*>(green+index));
+  low=_mm_unpacklo_epi8(first,second);
+  high=_mm_unpackhi_epi8(first,second);
+  first=_mm_loadu_si128(reinterpret_cast<const __m128i*>(red+index));
+  second=_mm_unpackhi_epi8(first,zero);
+  first=_mm_unpacklo_epi8(first,zero);
+  store_packed_sse2(target,_mm_unpacklo_epi16(low,first));
+  store_packed_sse2(target+12,_mm_unpackhi_epi16(low,first));
+  store_packed_sse2(target+24,_mm_unpacklo_epi16(high,second));
+  store_packed_sse2(target+36,_mm_unpackhi_epi16(high,second));
+  target+=48;
+ }
+ merge_planes(target,red+stop,green+stop,blue+stop,length-stop);
 }
+#endif
 
-void Frame::set_size(const unsigned long int surface_width,const unsigned long int surface_height)
+void expand_palette(unsigned char *target,const unsigned char *source,const unsigned char *palette,const size_t length)
 {
- frame_width=surface_width;
- frame_height=surface_height;
+ size_t index;
+ const unsigned char *color;
+ for (index=0;index<length;++index)
+ {
+  color=palette+static_cast<size_t>(source[index])*3;
+  target[0]=color[2];
+  target[1]=color[1];
+  target[2]=color[0];
+  target+=3;
+ }
+
 }
 
-void Frame::set_size(const SURFACE surface)
+void fill_pattern(unsigned char *target,const size_t pattern,const size_t length)
 {
- if (surface==SURFACE_SMALL) this->set_size(256,256);
- if (surface==SURFACE_LARGE) this->set_size(512,512);
+ size_t done,amount;
+ done=pattern;
+ while (done<length)
+ {
+  amount=done;
+  if (amount>length-done) amount=length-done;
+  memcpy(target+done,target,amount);
+  done+=amount;
+ }
+
 }
 
-void Frame::create_buffers()
+int compare_samples(const void *first,const void *second)
 {
- buffer=this->create_buffer("Can't allocate memory for render buffer");
- shadow=this->create_buffer("Can't allocate memory for shadow buffer");
+ unsigned long long int left,right;
+ int result;
+ left=*static_cast<const unsigned long long int*>(first);
+ right=*static_cast<const unsigned long long int*>(second);
+ result=0;
+ if (left<right) result=-1;
+ if (left>right) result=1;
+ return result;
 }
 
-unsigned long int Frame::get_frame_line() const
+double get_microseconds(const unsigned long long int value)
 {
- return frame_line;
+ return static_cast<double>(value)/1000.0;
 }
 
-unsigned int *Frame::get_buffer()
+void fill_span(unsigned int *target,const size_t length,const unsigned int color)
 {
- return buffer;
+ size_t index;
+ for (index=0;index<length;++index)
+ {
+  target[index]=color;
+ }
+
 }
 
-size_t Frame::get_pixels() const
+#ifdef BLACKGDK_SSE2
+SSE2_CODE void fill_span_sse2(unsigned int *target,const size_t length,const unsigned int color)
 {
- return pixels;
+ size_t index,stop;
+ __m128i pixels;
+ index=0;
+ while ((index<length)&&((reinterpret_cast<size_t>(target+index)%16)!=0))
+ {
+  target[index]=color;
+  ++index;
+ }
+ pixels=_mm_set1_epi32(static_cast<int>(color));
+ stop=index+(length-index)-(length-index)%16;
+ for (;index<stop;index+=16)
+ {
+  _mm_stream_si128(reinterpret_cast<__m128i*>(target+index),pixels);
+  _mm_stream_si128(reinterpret_cast<__m128i*>(target+index+4),pixels);
+  _mm_stream_si128(reinterpret_cast<__m128i*>(target+index+8),pixels);
+  _mm_stream_si128(reinterpret_cast<__m128i*>(target+index+12),pixels);
+ }
+ _mm_sfence();
+ fill_span(target+index,length-index,color);
 }
 
-bool Frame::draw_pixel(const unsigned long int x,const unsigned long int y,const unsigned long int red,const unsigned long int green,const unsigned long int blue)
+SSE2_CODE void double_span_sse2(unsigned int *target,const unsigned int *source,const size_t length)
 {
- bool result;
- size_t offset;
- result=false;
- offset=static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(frame_width);
- if (offset<pixels)
+ size_t index,stop;
+ __m128i pixels;
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
  {
-  buffer[offset]=blue+(green<<8)+(red<<16);
-  result=true;
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target),_mm_unpacklo_epi32(pixels,pixels));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+4),_mm_unpackhi_epi32(pixels,pixels));
+  target+=8;
  }
- return result;
+ double_span(target,source+stop,length-stop);
 }
 
-void Frame::clear_screen()
+SSE2_CODE void triple_span_sse2(unsigned int *target,const unsigned int *source,const size_t length)
 {
- this->clear_buffer(buffer);
+ size_t index,stop;
+ __m128i pixels;
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
+ {
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(1,0,0,0)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+4),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(2,2,1,1)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+8),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(3,3,3,2)));
+  target+=12;
+ }
+ triple_span(target,source+stop,length-stop);
 }
 
-void Frame::save()
+SSE2_CODE void quadruple_span_sse2(unsigned int *target,const unsigned int *source,const size_t length)
 {
- size_t index;
- for (index=0;index<pixels;++index)
+ size_t index,stop;
+ __m128i pixels;
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
  {
-  shadow[index]=buffer[index];
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(0,0,0,0)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+4),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(1,1,1,1)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+8),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(2,2,2,2)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+12),_mm_shuffle_epi32(pixels,_MM_SHUFFLE(3,3,3,3)));
+  target+=16;
  }
+ quadruple_span(target,source+stop,length-stop);
+}
 
+SSE2_CODE void mix_span_sse2(unsigned int *target,const unsigned int *first,const unsigned int *second,const size_t length,const unsigned int weight)
+{
+ size_t index,stop;
+ __m128i upper,lower,forward,backward,round,zero,low,high;
+ zero=_mm_setzero_si128();
+ round=_mm_set1_epi16(128);
+ forward=_mm_set1_epi16(static_cast<short int>(weight));
+ backward=_mm_set1_epi16(static_cast<short int>(256-weight));
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
+ {
+  upper=_mm_loadu_si128(reinterpret_cast<const __m128i*>(first+index));
+  lower=_mm_loadu_si128(reinterpret_cast<const __m128i*>(second+index));
+  low=_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(upper,zero),backward),_mm_mullo_epi16(_mm_unpacklo_epi8(lower,zero),forward));
+  high=_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(upper,zero),backward),_mm_mullo_epi16(_mm_unpackhi_epi8(lower,zero),forward));
+  low=_mm_srli_epi16(_mm_add_epi16(low,round),8);
+  high=_mm_srli_epi16(_mm_add_epi16(high,round),8);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+index),_mm_packus_epi16(low,high));
+ }
+ mix_span(target+stop,first+stop,second+stop,length-stop,weight);
 }
 
-void Frame::restore()
+SSE2_CODE void interpolate_span_sse2(unsigned int *target,const unsigned int *source,const unsigned long int *columns,const unsigned long int *weights,const size_t length)
 {
  size_t index;
- for (index=0;index<pixels;++index)
+ short int forward,backward;
+ __m128i pixels,factors,round,zero;
+ zero=_mm_setzero_si128();
+ round=_mm_set1_epi16(128);
+ for (index=0;index<length;++index)
  {
-  buffer[index]=shadow[index];
+  forward=static_cast<short int>(weights[index]);
+  backward=static_cast<short int>(256-weights[index]);
+  factors=_mm_set_epi16(forward,forward,forward,forward,backward,backward,backward,backward);
+  pixels=_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source+columns[index])),zero);
+  pixels=_mm_mullo_epi16(pixels,factors);
+  pixels=_mm_add_epi16(_mm_add_epi16(pixels,_mm_srli_si128(pixels,8)),round);
+  pixels=_mm_srli_epi16(pixels,8);
+  target[index]=static_cast<unsigned int>(_mm_cvtsi128_si32(_mm_packus_epi16(pixels,pixels)));
  }
 
 }
 
-void Frame::restore(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+SSE2_CODE void accumulate_span_sse2(unsigned int *sum,const unsigned int *source,const size_t length)
 {
- unsigned long int target_x,target_y,stop_x,stop_y;
- size_t position;
- stop_x=x+width;
- stop_y=y+height;
- if ((x<frame_width)&&(y<frame_height))
+ size_t index,stop;
+ __m128i pixels,low,high,zero;
+ __m128i *target;
+ zero=_mm_setzero_si128();
+ target=reinterpret_cast<__m128i*>(sum);
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
  {
-  if ((stop_x<=frame_width)&&(stop_y<=frame_height))
-  {
-   for (target_x=x;target_x<stop_x;++target_x)
-   {
-    for (target_y=y;target_y<stop_y;++target_y)
-    {
-     position=this->get_offset(target_x,target_y);
-     buffer[position]=shadow[position];
-    }
-
-   }
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  low=_mm_unpacklo_epi8(pixels,zero);
+  high=_mm_unpackhi_epi8(pixels,zero);
+  _mm_storeu_si128(target,_mm_add_epi32(_mm_loadu_si128(target),_mm_unpacklo_epi16(low,zero)));
+  _mm_storeu_si128(target+1,_mm_add_epi32(_mm_loadu_si128(target+1),_mm_unpackhi_epi16(low,zero)));
+  _mm_storeu_si128(target+2,_mm_add_epi32(_mm_loadu_si128(target+2),_mm_unpacklo_epi16(high,zero)));
+  _mm_storeu_si128(target+3,_mm_add_epi32(_mm_loadu_si128(target+3),_mm_unpackhi_epi16(high,zero)));
+  target+=4;
+ }
+ accumulate_span(sum+4*stop,source+stop,length-stop);
+}
 
-  }
+SSE2_CODE __m128i select_pixels_sse2(const __m128i mask,const __m128i first,const __m128i second)
+{
+ return _mm_or_si128(_mm_and_si128(mask,first),_mm_andnot_si128(mask,second));
+}
 
+SSE2_CODE void epx_line_sse2(unsigned int *first_line,unsigned int *second_line,const unsigned int *up,const unsigned int *row,const unsigned int *down,const size_t width)
+{
+ size_t index;
+ __m128i a,b,c,d,p,ca,cd,ab,bd,first,second,third,fourth;
+ epx_span(first_line,second_line,up,row,down,0,1,width);
+ for (index=1;index+5<=width;index+=4)
+ {
+  p=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row+index));
+  a=_mm_loadu_si128(reinterpret_cast<const __m128i*>(up+index));
+  b=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row+index+1));
+  c=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row+index-1));
+  d=_mm_loadu_si128(reinterpret_cast<const __m128i*>(down+index));
+  ca=_mm_cmpeq_epi32(c,a);
+  cd=_mm_cmpeq_epi32(c,d);
+  ab=_mm_cmpeq_epi32(a,b);
+  bd=_mm_cmpeq_epi32(b,d);
+  first=select_pixels_sse2(_mm_andnot_si128(ab,_mm_andnot_si128(cd,ca)),a,p);
+  second=select_pixels_sse2(_mm_andnot_si128(bd,_mm_andnot_si128(ca,ab)),b,p);
+  third=select_pixels_sse2(_mm_andnot_si128(ca,_mm_andnot_si128(bd,cd)),c,p);
+  fourth=select_pixels_sse2(_mm_andnot_si128(cd,_mm_andnot_si128(ab,bd)),d,p);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(first_line+2*index),_mm_unpacklo_epi32(first,second));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(first_line+2*index+4),_mm_unpackhi_epi32(first,second));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(second_line+2*index),_mm_unpacklo_epi32(third,fourth));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(second_line+2*index+4),_mm_unpackhi_epi32(third,fourth));
  }
-
+ if (index<width) epx_span(first_line,second_line,up,row,down,index,width,width);
 }
 
-unsigned long int Frame::get_frame_width() const
+SSE2_CODE __m128i divide_colors_sse2(__m128i value)
 {
- return frame_width;
+ value=_mm_add_epi16(value,_mm_set1_epi16(128));
+ return _mm_srli_epi16(_mm_add_epi16(value,_mm_srli_epi16(value,8)),8);
 }
 
-unsigned long int Frame::get_frame_height() const
+SSE2_CODE __m128i get_inverted_alpha_sse2(const __m128i colors)
 {
- return frame_height;
+ __m128i alpha;
+ alpha=_mm_shufflelo_epi16(colors,_MM_SHUFFLE(3,3,3,3));
+ alpha=_mm_shufflehi_epi16(alpha,_MM_SHUFFLE(3,3,3,3));
+ return _mm_sub_epi16(_mm_set1_epi16(255),alpha);
 }
 
-Plane::Plane()
+SSE2_CODE void blend_normal_span_sse2(unsigned int *target,const unsigned int *source,const size_t length)
 {
- target=NULL;
- plane=NULL;
- target_width=0;
- target_height=0;
- x_ratio=0;
- y_ratio=0;
+ size_t index,stop;
+ __m128i pixels,background,low,high,zero;
+ zero=_mm_setzero_si128();
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
+ {
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(pixels,zero))==0xFFFF) continue;
+  background=_mm_loadu_si128(reinterpret_cast<const __m128i*>(target+index));
+  low=_mm_mullo_epi16(_mm_unpacklo_epi8(background,zero),get_inverted_alpha_sse2(_mm_unpacklo_epi8(pixels,zero)));
+  high=_mm_mullo_epi16(_mm_unpackhi_epi8(background,zero),get_inverted_alpha_sse2(_mm_unpackhi_epi8(pixels,zero)));
+  background=_mm_packus_epi16(divide_colors_sse2(low),divide_colors_sse2(high));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+index),_mm_adds_epu8(pixels,background));
+ }
+ blend_normal_span(target+stop,source+stop,length-stop);
 }
 
-Plane::~Plane()
+SSE2_CODE void blend_additive_span_sse2(unsigned int *target,const unsigned int *source,const size_t length)
 {
+ size_t index,stop;
+ __m128i pixels,background;
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
+ {
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  background=_mm_loadu_si128(reinterpret_cast<const __m128i*>(target+index));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+index),_mm_adds_epu8(pixels,background));
+ }
+ blend_additive_span(target+stop,source+stop,length-stop);
+}
 
+SSE2_CODE void blend_multiply_span_sse2(unsigned int *target,const unsigned int *source,const size_t length)
+{
+ size_t index,stop;
+ __m128i pixels,background,color,low,high,zero;
+ zero=_mm_setzero_si128();
+ stop=length-length%4;
+ for (index=0;index<stop;index+=4)
+ {
+  pixels=_mm_loadu_si128(reinterpret_cast<const __m128i*>(source+index));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(pixels,zero))==0xFFFF) continue;
+  background=_mm_loadu_si128(reinterpret_cast<const __m128i*>(target+index));
+  low=divide_colors_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels,zero),_mm_unpacklo_epi8(background,zero)));
+  high=divide_colors_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels,zero),_mm_unpackhi_epi8(background,zero)));
+  color=_mm_packus_epi16(low,high);
+  low=_mm_mullo_epi16(_mm_unpacklo_epi8(background,zero),get_inverted_alpha_sse2(_mm_unpacklo_epi8(pixels,zero)));
+  high=_mm_mullo_epi16(_mm_unpackhi_epi8(background,zero),get_inverted_alpha_sse2(_mm_unpackhi_epi8(pixels,zero)));
+  background=_mm_packus_epi16(divide_colors_sse2(low),divide_colors_sse2(high));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(target+index),_mm_adds_epu8(color,background));
+ }
+ blend_multiply_span(target+stop,source+stop,length-stop);
 }
+#endif
 
-void Plane::create_plane(const unsigned long int width,const unsigned long int height,const unsigned long int surface_width,const unsigned long int surface_height,unsigned int *surface_buffer)
+#ifdef BLACKGDK_AVX2
+AVX2_CODE void draw_transparent_span_avx2(unsigned int *target,const unsigned int *source,const size_t length,const unsigned int key)
 {
- this->set_size(width,height);
- this->create_buffers();
- plane=this->get_buffer();
- target=surface_buffer;
- target_width=surface_width;
- target_height=surface_height;
- x_ratio=static_cast<float>(width)/static_cast<float>(surface_width);
- y_ratio=static_cast<float>(height)/static_cast<float>(surface_height);
+ size_t index,stop;
+ __m256i pixels,mask,color;
+ color=_mm256_set1_epi32(static_cast<int>(key));
+ stop=length-length%8;
+ for (index=0;index<stop;index+=8)
+ {
+  pixels=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source+index));
+  mask=_mm256_cmpeq_epi32(pixels,color);
+  if (_mm256_movemask_epi8(mask)!=-1)
+  {
+   mask=_mm256_xor_si256(mask,_mm256_set1_epi32(-1));
+   _mm256_maskstore_epi32(reinterpret_cast<int*>(target+index),mask,pixels);
+  }
+
+ }
+ _mm256_zeroupper();
+ draw_transparent_span(target+stop,source+stop,length-stop,key);
 }
+#endif
 
-void Plane::transfer()
+ COM_Base::COM_Base()
 {
- unsigned long int x,y,width;
- size_t index,position;
- width=this->get_frame_width();
- for (x=0;x<target_width;++x)
+ HRESULT status;
+ status=CoInitializeEx(NULL,COINIT_APARTMENTTHREADED);
+ if (status!=S_OK)
  {
-  for (y=0;y<target_height;++y)
+  if (status!=S_FALSE)
   {
-   index=this->get_offset(x,y,target_width);
-   position=this->get_offset((x_ratio*static_cast<float>(x)),(y_ratio*static_cast<float>(y)),width);
-   target[index]=plane[position];
+   Halt("Can't initialize COM");
   }
 
  }
 
 }
 
-Plane* Plane::get_handle()
+COM_Base::~COM_Base()
 {
- return this;
+ CoUninitialize();
 }
 
-Timer::Timer()
+Clock::Clock()
 {
- interval=0;
- start=time(NULL);
+ LARGE_INTEGER counter;
+ frequency=1;
+ counter.QuadPart=0;
+ QueryPerformanceFrequency(&counter);
+ if (counter.QuadPart>0) frequency=static_cast<unsigned long long int>(counter.QuadPart);
 }
 
-Timer::~Timer()
+Clock::~Clock()
 {
 
 }
 
-void Timer::set_timer(const unsigned long int seconds)
+unsigned long long int Clock::get_time() const
 {
- interval=seconds;
- start=time(NULL);
+ LARGE_INTEGER counter;
+ unsigned long long int value;
+ QueryPerformanceCounter(&counter);
+ value=static_cast<unsigned long long int>(counter.QuadPart);
+ return (value/frequency)*1000000000ULL+((value%frequency)*1000000000ULL)/frequency;
 }
 
-bool Timer::check_timer()
+Synchronization::Synchronization()
 {
- bool result;
- result=false;
- if (difftime(time(NULL),start)>=interval)
+ timer=NULL;
+ resolution=0;
+ rate=60;
+ missed=0;
+ period=0;
+ deadline=0;
+ spin=2000000;
+}
+
+Synchronization::~Synchronization()
+{
+ if (timer!=NULL)
  {
-  result=true;
-  start=time(NULL);
+  CancelWaitableTimer(timer);
+  CloseHandle(timer);
  }
- return result;
+ if (resolution>0) timeEndPeriod(resolution);
 }
 
-FPS::FPS()
+void Synchronization::sleep(const unsigned long long int interval)
 {
- timer.set_timer(1);
- current=0;
- fps=0;
+ LARGE_INTEGER start;
+ start.QuadPart=-static_cast<LONGLONG>(interval/100);
+ if (SetWaitableTimer(timer,&start,0,NULL,NULL,FALSE)==FALSE)
+ {
+  Halt("Can't set timer");
+ }
+ WaitForSingleObjectEx(timer,INFINITE,TRUE);
 }
 
-FPS::~FPS()
+void Synchronization::adjust_spin(const unsigned long long int error)
 {
-
+ spin=(spin*7+error+500000)/8;
+ if (spin>period) spin=period;
 }
 
-void FPS::update_counter()
+void Synchronization::create_timer()
 {
- ++current;
- if (timer.check_timer()==true)
+ TIMECAPS capabilities;
+ if (timer==NULL) timer=CreateWaitableTimer(NULL,FALSE,NULL);
+ if (timer==NULL)
  {
-  fps=current;
-  current=0;
+  Halt("Can't create synchronization timer");
+ }
+ if (resolution>0) return;
+ if (timeGetDevCaps(&capabilities,sizeof(TIMECAPS))==TIMERR_NOERROR)
+ {
+  if (timeBeginPeriod(capabilities.wPeriodMin)==TIMERR_NOERROR) resolution=capabilities.wPeriodMin;
  }
 
 }
 
-unsigned long int FPS::get_fps() const
+void Synchronization::start_timer()
 {
- return fps;
+ period=0;
+ if (rate>0) period=1000000000ULL/rate;
+ missed=0;
+ deadline=clock.get_time()+period;
 }
 
-Unicode_Convertor::Unicode_Convertor()
+void Synchronization::wait_timer()
 {
- target=NULL;
+ unsigned long long int now,target,error;
+ if (period>0)
+ {
+  now=clock.get_time();
+  if (now<deadline)
+  {
+   if (deadline-now>spin)
+   {
+    target=deadline-spin;
+    this->sleep(target-now);
+    now=clock.get_time();
+    error=0;
+    if (now>target) error=now-target;
+    this->adjust_spin(error);
+   }
+   while (clock.get_time()<deadline)
+   {
+    YieldProcessor();
+   }
+   deadline+=period;
+  }
+  else
+  {
+   ++missed;
+   deadline+=period;
+   if (now>=deadline) deadline=now+period;
+  }
+
+ }
+
 }
 
-Unicode_Convertor::~Unicode_Convertor()
+void Synchronization::set_rate(const unsigned long int fps)
 {
- if (target!=NULL) delete[] target;
+ rate=fps;
+ this->start_timer();
 }
 
-void Unicode_Convertor::get_memory(const size_t length)
+unsigned long int Synchronization::get_rate() const
 {
- try
- {
-  target=new wchar_t[length+1];
- }
- catch (...)
- {
-  Halt("Can't allocate memory");
- }
-
+ return rate;
 }
 
-void Unicode_Convertor::clear_buffer(const size_t length)
+unsigned long int Synchronization::get_missed() const
 {
- size_t index,stop;
- stop=length+1;
- for (index=0;index<stop;++index)
- {
-  target[index]=0;
- }
+ return missed;
+}
 
+Processor::Processor()
+{
+ sse2=false;
+ avx2=false;
+ threads=1;
+ this->detect();
 }
 
-void Unicode_Convertor::create_buffer(const size_t length)
+Processor::~Processor()
 {
- this->get_memory(length);
- this->clear_buffer(length);
+
 }
 
-void Unicode_Convertor::convert_string(const char *source)
+void Processor::detect()
 {
- size_t index,length;
- length=strlen(source);
- for (index=0;index<length;++index)
+ SYSTEM_INFO information;
+ GetSystemInfo(&information);
+ if (information.dwNumberOfProcessors>1) threads=information.dwNumberOfProcessors;
+ #ifdef BLACKGDK_SSE2
+ unsigned int leaf[4];
+ unsigned int extended[4];
+ unsigned long long int state;
+ memset(leaf,0,sizeof(leaf));
+ memset(extended,0,sizeof(extended));
+ state=0;
+ #ifdef _MSC_VER
+ __cpuid(reinterpret_cast<int*>(leaf),1);
+ #else
+ __cpuid(1,leaf[0],leaf[1],leaf[2],leaf[3]);
+ #endif
+ sse2=(leaf[3]&(1U<<26))!=0;
+ #ifdef BLACKGDK_AVX2
+ if ((leaf[2]&(1U<<27))!=0)
  {
-  target[index]=btowc(source[index]);
+  #ifdef _MSC_VER
+  state=_xgetbv(0);
+  __cpuidex(reinterpret_cast<int*>(extended),7,0);
+  #else
+  __asm__ __volatile__ ("xgetbv" : "=a"(leaf[0]),"=d"(leaf[1]) : "c"(0));
+  state=static_cast<unsigned long long int>(leaf[0])|(static_cast<unsigned long long int>(leaf[1])<<32);
+  __cpuid_count(7,0,extended[0],extended[1],extended[2],extended[3]);
+  #endif
+  avx2=((state&6)==6)&&((extended[1]&(1U<<5))!=0);
  }
-
+ #endif
+ #endif
 }
 
-wchar_t *Unicode_Convertor::convert(const char *source)
+bool Processor::check_sse2() const
 {
- this->create_buffer(strlen(source));
- this->convert_string(source);
- return target;
+ return sse2;
 }
 
-Render::Render()
+bool Processor::check_avx2() const
 {
- render=NULL;
- target=NULL;
- surface=NULL;
- source=D2D1::RectU(0,0,0,0);
- destanation=D2D1::RectF(0,0,0,0);
- texture=D2D1::RectF(0,0,0,0);
- setting.dpiX=0;
- setting.dpiY=0;
- setting.type=D2D1_RENDER_TARGET_TYPE_HARDWARE;
- setting.pixelFormat=D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM,D2D1_ALPHA_MODE_IGNORE);
- setting.usage=D2D1_RENDER_TARGET_USAGE_NONE;
- setting.minLevel=D2D1_FEATURE_LEVEL_9;
- configuration.hwnd=NULL;
- configuration.pixelSize=D2D1::SizeU(0,0);
- configuration.presentOptions=D2D1_PRESENT_OPTIONS_IMMEDIATELY;
+ return avx2;
 }
 
-Render::~Render()
+unsigned long int Processor::get_threads() const
 {
- if (surface!=NULL) surface->Release();
- if (target!=NULL) target->Release();
- if (render!=NULL) render->Release();
+ return threads;
 }
 
-void Render::create_factory()
+Thread_Pool::Thread_Pool()
 {
- if (D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED,&render)!=S_OK)
- {
-  Halt("Can't create render");
- }
-
+ threads=NULL;
+ start=NULL;
+ finish=NULL;
+ next=0;
+ active=0;
+ amount=0;
+ jobs=0;
+ stopping=false;
+ task=NULL;
+ context=NULL;
 }
 
-void Render::create_target()
+Thread_Pool::~Thread_Pool()
 {
- if (render->CreateHwndRenderTarget(setting,configuration,&target)!=S_OK)
- {
-  Halt("Can't create render target");
- }
- target->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+ this->destroy();
 }
 
-void Render::create_surface()
+DWORD WINAPI Thread_Pool::work(LPVOID target)
 {
- if (target->CreateBitmap(D2D1::SizeU(this->get_frame_width(),this->get_frame_height()),this->get_buffer(),this->get_frame_line(),D2D1::BitmapProperties(setting.pixelFormat,96.0,96.0),&surface)!=S_OK)
+ Thread_Pool *pool;
+ pool=static_cast<Thread_Pool*>(target);
+ while (true)
  {
-  Halt("Can't create render surface");
+  WaitForSingleObject(pool->start,INFINITE);
+  if (pool->stopping==true) break;
+  pool->execute();
+  if (InterlockedDecrement(&pool->active)==0) SetEvent(pool->finish);
  }
-
+ return 0;
 }
 
-void Render::set_render_setting()
+void Thread_Pool::execute()
 {
- configuration.hwnd=this->get_window();
- configuration.pixelSize=D2D1::SizeU(this->get_width(),this->get_height());
-}
+ unsigned long int index;
+ while (true)
+ {
+  index=static_cast<unsigned long int>(InterlockedIncrement(&next)-1);
+  if (index>=jobs) break;
+  task(context,index);
+ }
 
-void Render::set_render()
-{
- this->set_render_setting();
- this->create_factory();
- this->create_target();
- this->create_surface();
 }
 
-void Render::destroy_resource()
+void Thread_Pool::create(const unsigned long int workers)
 {
- if (surface!=NULL)
+ unsigned long int index;
+ this->destroy();
+ start=CreateSemaphore(NULL,0,static_cast<LONG>(workers)+1,NULL);
+ finish=CreateEvent(NULL,FALSE,FALSE,NULL);
+ if ((start==NULL)||(finish==NULL))
  {
-  surface->Release();
-  surface=NULL;
+  Halt("Can't create synchronization objects for worker threads");
  }
- if (target!=NULL)
+ try
  {
-  target->Release();
-  target=NULL;
+  threads=new HANDLE[workers];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for worker threads");
  }
+ stopping=false;
+ for (index=0;index<workers;++index)
+ {
+  threads[index]=CreateThread(NULL,0,Thread_Pool::work,this,0,NULL);
+  if (threads[index]==NULL)
+  {
+   Halt("Can't create worker thread");
+  }
 
+ }
+ amount=workers;
 }
 
-void Render::recreate_render()
+void Thread_Pool::destroy()
 {
- this->destroy_resource();
- this->create_target();
- this->create_surface();
+ unsigned long int index;
+ if (threads!=NULL)
+ {
+  stopping=true;
+  ReleaseSemaphore(start,static_cast<LONG>(amount),NULL);
+  for (index=0;index<amount;++index)
+  {
+   WaitForSingleObject(threads[index],INFINITE);
+   CloseHandle(threads[index]);
+  }
+  delete[] threads;
+  threads=NULL;
+ }
+ if (start!=NULL)
+ {
+  CloseHandle(start);
+  start=NULL;
+ }
+ if (finish!=NULL)
+ {
+  CloseHandle(finish);
+  finish=NULL;
+ }
+ amount=0;
 }
 
-void Render::prepare_surface()
+unsigned long int Thread_Pool::get_amount() const
 {
- source=D2D1::RectU(0,0,this->get_frame_width(),this->get_frame_height());
- destanation=D2D1::RectF(0,0,this->get_width(),this->get_height());
- texture=D2D1::RectF(0,0,this->get_frame_width(),this->get_frame_height());
+ return amount;
 }
 
-void Render::create_render()
+void Thread_Pool::run(void (*job)(void *target,const unsigned long int index),void *target,const unsigned long int total)
 {
- this->set_render_setting();
- this->set_render();
- this->prepare_surface();
- this->create_buffers();
+ task=job;
+ context=target;
+ jobs=total;
+ next=0;
+ active=static_cast<LONG>(amount);
+ if (amount>0) ReleaseSemaphore(start,static_cast<LONG>(amount),NULL);
+ this->execute();
+ if (amount>0) WaitForSingleObject(finish,INFINITE);
 }
 
-void Render::refresh()
+Engine::Engine()
 {
- surface->CopyFromMemory(&source,this->get_buffer(),this->get_frame_line());
- target->BeginDraw();
- target->DrawBitmap(surface,destanation,1.0,D2D1_BITMAP_INTERPOLATION_MODE_LINEAR,texture);
- if (target->EndDraw()==(HRESULT)D2DERR_RECREATE_TARGET) this->recreate_render();
-}
-
-Screen::Screen()
-{
-
+ window_class.lpszClassName=TEXT("BLACKGDK");
+ window_class.style=CS_HREDRAW|CS_VREDRAW;
+ window_class.cbSize=sizeof(WNDCLASSEX);
+ window_class.lpfnWndProc=Process_Message;
+ window_class.hInstance=NULL;
+ window_class.hbrBackground=NULL;
+ window_class.hIcon=NULL;
+ window_class.hCursor=NULL;
+ window_class.hIconSm=NULL;
+ window_class.cbClsExtra=0;
+ window_class.cbWndExtra=0;
+ window=NULL;
 }
 
-Screen::~Screen()
+Engine::~Engine()
 {
-
+ if (window!=NULL) CloseWindow(window);
+ UnregisterClass(window_class.lpszClassName,window_class.hInstance);
 }
 
-void Screen::initialize()
+void Engine::get_instance()
 {
- this->prepare_engine();
- this->create_buffers();
- this->create_timer();
- this->create_window();
- this->capture_mouse();
- this->create_render();
- this->set_timer(17);
-}
+ if (GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,NULL,&window_class.hInstance)==FALSE)
+ {
+  Halt("Can't get the application instance");
+ }
 
-void Screen::initialize(const SURFACE surface)
-{
- this->set_size(surface);
- this->initialize();
 }
 
-bool Screen::update()
+void Engine::load_icon()
 {
- this->refresh();
- this->update_counter();
- return this->process_message();
-}
+ window_class.hIcon=LoadIcon(NULL,IDI_APPLICATION);
+ if (window_class.hIcon==NULL)
+ {
+  Halt("Can't load the standart program icon");
+ }
 
-bool Screen::sync()
-{
- bool run;
- run=this->update();
- this->wait_timer();
- return run;
 }
 
-Screen* Screen::get_handle()
+void Engine::load_cursor()
 {
- return this;
-}
+ window_class.hCursor=LoadCursor(NULL,IDC_ARROW);
+ if (window_class.hCursor==NULL)
+ {
+  Halt("Can't load the standart cursor");
+ }
 
-Keyboard::Keyboard()
-{
- preversion=NULL;
 }
 
-Keyboard::~Keyboard()
+void Engine::register_window_class()
 {
- if (preversion!=NULL)
+ if (!RegisterClassEx(&window_class))
  {
-  delete[] preversion;
-  preversion=NULL;
+  Halt("Can't register window class");
  }
 
 }
 
-void Keyboard::create_buffer()
+HWND Engine::get_window()
 {
- try
- {
-  preversion=new unsigned char[KEYBOARD];
- }
- catch (...)
- {
-  Halt("Can't allocate memory for keyboard state buffer");
- }
+ return window;
+}
 
+void Engine::prepare_engine()
+{
+ this->get_instance();
+ this->load_icon();
+ this->load_cursor();
+ this->register_window_class();
 }
 
-void Keyboard::clear_buffer()
+void Engine::create_window()
 {
- size_t index;
- for (index=0;index<KEYBOARD;++index)
+ window=CreateWindowEx(WS_EX_APPWINDOW,window_class.lpszClassName,NULL,WS_VISIBLE|WS_POPUP,0,0,GetSystemMetrics(SM_CXSCREEN),GetSystemMetrics(SM_CYSCREEN),NULL,NULL,window_class.hInstance,NULL);
+ if (window==NULL)
  {
-  preversion[index]=KEY_RELEASE;
+  Halt("Can't create window");
  }
-
+ SetFocus(window);
 }
 
-bool Keyboard::check_state(const unsigned char code,const unsigned char state)
+void Engine::capture_mouse()
 {
- bool result;
- result=false;
- if (Keys[code]==state)
+ RECT border;
+ if (GetClientRect(window,&border)==FALSE)
  {
-  if (preversion[code]!=state) result=true;
+  Halt("Can't capture window");
+ }
+ if (ClipCursor(&border)==FALSE)
+ {
+  Halt("Can't capture cursor");
  }
- preversion[code]=Keys[code];
- return result;
-}
 
-void Keyboard::initialize()
-{
- this->create_buffer();
- this->clear_buffer();
 }
 
-bool Keyboard::check_hold(const unsigned char code)
+bool Engine::process_message()
 {
- bool result;
- result=false;
- if (Keys[code]==KEY_PRESS) result=true;
- preversion[code]=Keys[code];
- return result;
-}
+ bool run;
+ MSG Message;
+ run=true;
+ while(PeekMessage(&Message,window,0,0,PM_NOREMOVE)==TRUE)
+ {
+  if (GetMessage(&Message,window,0,0)==TRUE)
+  {
+   TranslateMessage(&Message);
+   DispatchMessage(&Message);
+  }
+  else
+  {
+   run=false;
+   break;
+  }
 
-bool Keyboard::check_press(const unsigned char code)
-{
- return this->check_state(code,KEY_PRESS);
+ }
+ return run;
 }
 
-bool Keyboard::check_release(const unsigned char code)
+unsigned long int Engine::get_width()
 {
- return this->check_state(code,KEY_RELEASE);
+ return GetSystemMetrics(SM_CXSCREEN);
 }
 
-Mouse::Mouse()
+unsigned long int Engine::get_height()
 {
- preversion[MOUSE_LEFT]=KEY_RELEASE;
- preversion[MOUSE_RIGHT]=KEY_RELEASE;
- preversion[MOUSE_MIDDLE]=KEY_RELEASE;
- position.x=0;
- position.y=0;
+ return GetSystemMetrics(SM_CYSCREEN);
 }
 
-Mouse::~Mouse()
+Region::Region()
 {
- while(ShowCursor(TRUE)<1) ;
+ amount=0;
 }
 
-void Mouse::get_position()
+Region::~Region()
 {
- if (GetCursorPos(&position)==FALSE)
- {
-  Halt("Can't get the mouse cursor position");
- }
 
 }
 
-bool Mouse::check_state(const MOUSE_BUTTON button,const unsigned char state)
+bool Region::check_contact(const Collision_Box &first,const Collision_Box &second) const
 {
  bool result;
  result=false;
- if (Buttons[button]==state)
+ if ((first.x<=second.x+second.width)&&(second.x<=first.x+first.width))
  {
-  if (preversion[button]!=state) result=true;
+  if ((first.y<=second.y+second.height)&&(second.y<=first.y+first.height)) result=true;
  }
- preversion[button]=Buttons[button];
  return result;
 }
 
-void Mouse::show()
+Collision_Box Region::merge_boxes(const Collision_Box &first,const Collision_Box &second) const
 {
- while(ShowCursor(TRUE)<1) ;
+ Collision_Box result;
+ unsigned long int stop_x,stop_y;
+ result.x=first.x;
+ result.y=first.y;
+ if (second.x<result.x) result.x=second.x;
+ if (second.y<result.y) result.y=second.y;
+ stop_x=first.x+first.width;
+ stop_y=first.y+first.height;
+ if (second.x+second.width>stop_x) stop_x=second.x+second.width;
+ if (second.y+second.height>stop_y) stop_y=second.y+second.height;
+ result.width=stop_x-result.x;
+ result.height=stop_y-result.y;
+ return result;
 }
 
-void Mouse::hide()
+size_t Region::get_area(const Collision_Box &target) const
 {
- while(ShowCursor(FALSE)>-2) ;
+ return static_cast<size_t>(target.width)*static_cast<size_t>(target.height);
 }
 
-void Mouse::set_position(const unsigned long int x,const unsigned long int y)
+void Region::remove(const size_t index)
 {
- if (SetCursorPos(x,y)==FALSE)
- {
-  Halt("Can't set the mouse cursor position");
- }
-
+ --amount;
+ boxes[index]=boxes[amount];
 }
 
-unsigned long int Mouse::get_x()
+void Region::clear()
 {
- this->get_position();
- return position.x;
+ amount=0;
 }
 
-unsigned long int Mouse::get_y()
+void Region::add(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
 {
- this->get_position();
- return position.y;
+ Collision_Box target;
+ target.x=x;
+ target.y=y;
+ target.width=width;
+ target.height=height;
+ this->add(target);
 }
 
-bool Mouse::check_hold(const MOUSE_BUTTON button)
+void Region::add(const Collision_Box &target)
 {
- bool result;
- result=false;
- if (Buttons[button]==KEY_PRESS)
+ Collision_Box box;
+ size_t index,best,growth,smallest;
+ box=target;
+ index=0;
+ while (index<amount)
  {
-  result=true;
+  if (this->check_contact(box,boxes[index])==true)
+  {
+   box=this->merge_boxes(box,boxes[index]);
+   this->remove(index);
+   index=0;
+  }
+  else
+  {
+   ++index;
+  }
+
  }
- preversion[button]=Buttons[button];
- return result;
-}
+ if (amount==sizeof(boxes)/sizeof(Collision_Box))
+ {
+  best=0;
+  smallest=this->get_area(this->merge_boxes(box,boxes[0]))-this->get_area(boxes[0]);
+  for (index=1;index<amount;++index)
+  {
+   growth=this->get_area(this->merge_boxes(box,boxes[index]))-this->get_area(boxes[index]);
+   if (growth<smallest)
+   {
+    smallest=growth;
+    best=index;
+   }
 
-bool Mouse::check_press(const MOUSE_BUTTON button)
-{
- return this->check_state(button,KEY_PRESS);
-}
+  }
+  box=this->merge_boxes(box,boxes[best]);
+  this->remove(best);
+  this->add(box);
+ }
+ else
+ {
+  boxes[amount]=box;
+  ++amount;
+ }
 
-bool Mouse::check_release(const MOUSE_BUTTON button)
-{
- return this->check_state(button,KEY_RELEASE);
 }
 
-Gamepad::Gamepad()
+size_t Region::get_amount() const
 {
- length=sizeof(XINPUT_STATE);
- XInputEnable(TRUE);
- memset(&current,0,length);
- memset(&preversion,0,length);
- memset(&vibration,0,sizeof(XINPUT_VIBRATION));
- memset(&battery,0,sizeof(XINPUT_BATTERY_INFORMATION));
- active=0;
+ return amount;
 }
 
-Gamepad::~Gamepad()
+Collision_Box Region::get_box(const size_t index) const
 {
- XInputEnable(FALSE);
+ return boxes[index];
 }
 
-bool Gamepad::read_battery_status()
+Filter::Filter()
 {
- return XInputGetBatteryInformation(active,BATTERY_DEVTYPE_GAMEPAD,&battery)==ERROR_SUCCESS;
+ kind=NEAREST_FILTER;
+ mode=NEAREST_FILTER;
+ target=NULL;
+ source=NULL;
+ target_width=0;
+ target_height=0;
+ source_width=0;
+ source_height=0;
+ target_stride=0;
+ source_stride=0;
+ bands=1;
+ columns=NULL;
+ weights=NULL;
+ table_mode=NEAREST_FILTER;
+ table_width=0;
+ table_length=0;
+ lines=NULL;
+ line_amount=0;
+ line_length=0;
+ stages[0]=NULL;
+ stages[1]=NULL;
+ stage_length[0]=0;
+ stage_length[1]=0;
+ this->select_kernels();
+}
+
+Filter::~Filter()
+{
+ this->destroy_tables();
+ this->destroy_lines();
+ this->destroy_stages();
+}
+
+void Filter::select_kernels()
+{
+ Processor processor;
+ vertical_kernel=mix_span;
+ horizontal_kernel=interpolate_span;
+ box_kernel=accumulate_span;
+ epx_kernel=epx_line;
+ #ifdef BLACKGDK_SSE2
+ if (processor.check_sse2()==true)
+ {
+  vertical_kernel=mix_span_sse2;
+  horizontal_kernel=interpolate_span_sse2;
+  box_kernel=accumulate_span_sse2;
+  epx_kernel=epx_line_sse2;
+ }
+ #endif
 }
 
-void Gamepad::clear_state()
+unsigned long int *Filter::create_table(const unsigned long int length)
 {
- memset(&current,0,length);
- memset(&preversion,0,length);
+ unsigned long int *table;
+ table=NULL;
+ try
+ {
+  table=new unsigned long int[length+1];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for filter table");
+ }
+ return table;
 }
 
-bool Gamepad::read_state()
+void Filter::destroy_tables()
 {
- return XInputGetState(active,&current)==ERROR_SUCCESS;
+ if (columns!=NULL)
+ {
+  delete[] columns;
+  columns=NULL;
+ }
+ if (weights!=NULL)
+ {
+  delete[] weights;
+  weights=NULL;
+ }
+
 }
 
-bool Gamepad::write_state()
+void Filter::prepare_tables()
 {
- return XInputSetState(active,&vibration)==ERROR_SUCCESS;
-}
+ unsigned long int x;
+ unsigned long long int position;
+ float ratio;
+ if ((mode==EPX_FILTER)||((columns!=NULL)&&(table_mode==mode)&&(table_width==source_width)&&(table_length==target_width))) return;
+ this->destroy_tables();
+ columns=this->create_table(target_width);
+ weights=this->create_table(target_width);
+ table_mode=mode;
+ table_width=source_width;
+ table_length=target_width;
+ ratio=static_cast<float>(source_width)/static_cast<float>(target_width);
+ for (x=0;x<target_width;++x)
+ {
+  columns[x]=ratio*static_cast<float>(x);
+  weights[x]=0;
+  if (mode==BILINEAR_FILTER)
+  {
+   position=((2*static_cast<unsigned long long int>(x)+1)*source_width*256)/(2*static_cast<unsigned long long int>(target_width));
+   if (position<128) position=128;
+   position-=128;
+   columns[x]=static_cast<unsigned long int>(position>>8);
+   weights[x]=static_cast<unsigned long int>(position&255);
+   if (columns[x]>=source_width-1)
+   {
+    columns[x]=source_width-1;
+    weights[x]=0;
+   }
 
-void Gamepad::set_motor(const unsigned short int left,const unsigned short int right)
-{
- vibration.wLeftMotorSpeed=left;
- vibration.wRightMotorSpeed=right;
-}
+  }
+  if (mode==BOX_FILTER)
+  {
+   columns[x]=static_cast<unsigned long int>((static_cast<unsigned long long int>(x)*source_width)/target_width);
+   weights[x]=static_cast<unsigned long int>(((static_cast<unsigned long long int>(x)+1)*source_width)/target_width);
+   if (weights[x]<=columns[x]) weights[x]=columns[x]+1;
+  }
+
+ }
 
-bool Gamepad::check_button(XINPUT_STATE &target,const GAMEPAD_BUTTONS button)
-{
- bool result;
- result=false;
- if (target.Gamepad.wButtons&button) result=true;
- return result;
 }
 
-bool Gamepad::check_trigger(XINPUT_STATE &target,const GAMEPAD_TRIGGERS trigger)
+void Filter::destroy_lines()
 {
- bool result;
- result=false;
- if (trigger==GAMEPAD_LEFT_TRIGGER)
- {
-  if (target.Gamepad.bLeftTrigger>=XINPUT_GAMEPAD_TRIGGER_THRESHOLD) result=true;
- }
- else
+ unsigned long int index;
+ if (lines!=NULL)
  {
-  if (target.Gamepad.bRightTrigger>=XINPUT_GAMEPAD_TRIGGER_THRESHOLD) result=true;
+  for (index=0;index<line_amount;++index)
+  {
+   if (lines[index]!=NULL) delete[] lines[index];
+  }
+  delete[] lines;
+  lines=NULL;
  }
- return result;
+ line_amount=0;
+ line_length=0;
 }
 
-void Gamepad::set_active(const unsigned long int gamepad)
+void Filter::prepare_lines()
 {
- if (active<XUSER_MAX_COUNT)
+ unsigned long int index;
+ size_t length;
+ length=static_cast<size_t>(source_width)*4+1;
+ if ((lines==NULL)||(line_amount<bands)||(line_length<length))
  {
-  this->clear_state();
-  active=gamepad;
+  this->destroy_lines();
+  try
+  {
+   lines=new unsigned int*[bands];
+  }
+  catch (...)
+  {
+   Halt("Can't allocate memory for filter line");
+  }
+  for (index=0;index<bands;++index)
+  {
+   lines[index]=NULL;
+  }
+  line_amount=bands;
+  line_length=length;
+  for (index=0;index<bands;++index)
+  {
+   try
+   {
+    lines[index]=new unsigned int[length];
+   }
+   catch (...)
+   {
+    Halt("Can't allocate memory for filter line");
+   }
+
+  }
+
  }
 
 }
 
-unsigned long int Gamepad::get_active() const
+void Filter::destroy_stages()
 {
- return active;
-}
+ unsigned long int index;
+ for (index=0;index<2;++index)
+ {
+  if (stages[index]!=NULL)
+  {
+   delete[] stages[index];
+   stages[index]=NULL;
+  }
+  stage_length[index]=0;
+ }
 
-unsigned long int Gamepad::get_maximum_amount()
-{
- return XUSER_MAX_COUNT;
 }
 
-unsigned long int Gamepad::get_amount()
+unsigned int *Filter::get_stage(const unsigned long int index,const size_t length)
 {
- unsigned long int old,result;
- result=0;
- old=active;
- for (active=0;active<XUSER_MAX_COUNT;++active)
+ if (stage_length[index]<length)
  {
-  if (this->read_state()==true)
+  if (stages[index]!=NULL) delete[] stages[index];
+  stages[index]=NULL;
+  try
   {
-   this->clear_state();
-   result=active+1;
+   stages[index]=new unsigned int[length];
   }
-
+  catch (...)
+  {
+   Halt("Can't allocate memory for filter buffer");
+  }
+  stage_length[index]=length;
  }
- active=old;
- return result;
+ return stages[index];
 }
 
-unsigned long int Gamepad::get_last_index()
+unsigned long int Filter::get_units() const
 {
- unsigned long int last_index;
- last_index=this->get_amount();
- if (last_index>0) --last_index;
- return last_index;
+ unsigned long int result;
+ result=target_height;
+ if (mode==EPX_FILTER) result=source_height;
+ return result;
 }
 
-bool Gamepad::check_connection()
+void Filter::nearest_rows(const unsigned long int first,const unsigned long int last)
 {
- return this->read_state();
+ unsigned long int y,row;
+ float ratio;
+ ratio=static_cast<float>(source_height)/static_cast<float>(target_height);
+ for (y=first;y<last;++y)
+ {
+  row=ratio*static_cast<float>(y);
+  scale_span(target+static_cast<size_t>(y)*static_cast<size_t>(target_stride),source+static_cast<size_t>(row)*static_cast<size_t>(source_stride),columns,target_width);
+ }
+
 }
 
-bool Gamepad::is_wireless()
+void Filter::bilinear_rows(const unsigned long int first,const unsigned long int last,unsigned int *line)
 {
- bool result;
- result=false;
- if (this->read_battery_status()==true)
+ unsigned long int y,row,next;
+ unsigned long long int position;
+ for (y=first;y<last;++y)
  {
-  if (battery.BatteryType!=BATTERY_TYPE_WIRED) result=true;
+  position=((2*static_cast<unsigned long long int>(y)+1)*source_height*256)/(2*static_cast<unsigned long long int>(target_height));
+  if (position<128) position=128;
+  position-=128;
+  row=static_cast<unsigned long int>(position>>8);
+  if (row>=source_height-1)
+  {
+   row=source_height-1;
+   position=0;
+  }
+  next=row;
+  if (row+1<source_height) next=row+1;
+  vertical_kernel(line,source+static_cast<size_t>(row)*static_cast<size_t>(source_stride),source+static_cast<size_t>(next)*static_cast<size_t>(source_stride),source_width,static_cast<unsigned int>(position&255));
+  line[source_width]=line[source_width-1];
+  horizontal_kernel(target+static_cast<size_t>(y)*static_cast<size_t>(target_stride),line,columns,weights,target_width);
  }
- return result;
+
 }
 
-GAMEPAD_BATTERY_TYPE Gamepad::get_battery_type()
+void Filter::box_rows(const unsigned long int first,const unsigned long int last,unsigned int *sum)
 {
- GAMEPAD_BATTERY_TYPE result;
- result=GAMEPAD_BATTERY_TYPE_ERROR;
- if (this->read_battery_status()==true)
+ unsigned long int x,y,row,start,stop,column;
+ unsigned long long int total[4];
+ unsigned long long int amount;
+ unsigned int *output;
+ unsigned int channel;
+ for (y=first;y<last;++y)
  {
-  switch (battery.BatteryType)
+  start=static_cast<unsigned long int>((static_cast<unsigned long long int>(y)*source_height)/target_height);
+  stop=static_cast<unsigned long int>(((static_cast<unsigned long long int>(y)+1)*source_height)/target_height);
+  if (stop<=start) stop=start+1;
+  memset(sum,0,static_cast<size_t>(source_width)*4*sizeof(unsigned int));
+  for (row=start;row<stop;++row)
   {
-   case BATTERY_TYPE_ALKALINE:
-   result=GAMEPAD_BATTERY_ALKAINE;
-   break;
-   case BATTERY_TYPE_NIMH:
-   result=GAMEPAD_BATTERY_NIMH;
-   break;
-   case BATTERY_TYPE_UNKNOWN:
-   result=GAMEPAD_BATTERY_UNKNOW;
-   break;
+   box_kernel(sum,source+static_cast<size_t>(row)*static_cast<size_t>(source_stride),source_width);
+  }
+  output=target+static_cast<size_t>(y)*static_cast<size_t>(target_stride);
+  for (x=0;x<target_width;++x)
+  {
+   memset(total,0,sizeof(total));
+   for (column=columns[x];column<weights[x];++column)
+   {
+    for (channel=0;channel<4;++channel)
+    {
+     total[channel]+=sum[4*column+channel];
+    }
+
+   }
+   amount=static_cast<unsigned long long int>(weights[x]-columns[x])*static_cast<unsigned long long int>(stop-start);
+   output[x]=0;
+   for (channel=0;channel<4;++channel)
+   {
+    output[x]|=static_cast<unsigned int>((total[channel]+amount/2)/amount)<<(8*channel);
+   }
+
   }
 
  }
- return result;
+
 }
 
-GAMEPAD_BATTERY_LEVEL Gamepad::get_battery_level()
+void Filter::epx_rows(const unsigned long int first,const unsigned long int last)
 {
- GAMEPAD_BATTERY_LEVEL result;
- result=GAMEPAD_BATTERY_LEVEL_ERROR;
- if (this->read_battery_status()==true)
+ unsigned long int y,up,down;
+ unsigned int *output;
+ for (y=first;y<last;++y)
  {
-  switch (battery.BatteryLevel)
-  {
-   case BATTERY_LEVEL_EMPTY:
-   result=GAMEPAD_BATTERY_EMPTY;
-   break;
-   case BATTERY_LEVEL_LOW:
-   result=GAMEPAD_BATTERY_LOW;
-   break;
-   case BATTERY_LEVEL_MEDIUM:
-   result=GAMEPAD_BATTERY_MEDIUM;
-   break;
-   case BATTERY_LEVEL_FULL:
-   result=GAMEPAD_BATTERY_FULL;
-   break;
-  }
-  if ((battery.BatteryType==BATTERY_TYPE_WIRED)||(battery.BatteryType==BATTERY_TYPE_DISCONNECTED)) result=GAMEPAD_BATTERY_LEVEL_ERROR;
+  up=y;
+  down=y;
+  if (y>0) up=y-1;
+  if (y+1<source_height) down=y+1;
+  output=target+2*static_cast<size_t>(y)*static_cast<size_t>(target_stride);
+  epx_kernel(output,output+target_stride,source+static_cast<size_t>(up)*static_cast<size_t>(source_stride),source+static_cast<size_t>(y)*static_cast<size_t>(source_stride),source+static_cast<size_t>(down)*static_cast<size_t>(source_stride),source_width);
  }
- return result;
+
 }
 
-void Gamepad::update()
+void Filter::scale_band(const unsigned long int band)
 {
- preversion=current;
- if (this->read_state()==false) this->clear_state();
+ unsigned long int first,last;
+ first=static_cast<unsigned long int>((static_cast<unsigned long long int>(band)*this->get_units())/bands);
+ last=static_cast<unsigned long int>(((static_cast<unsigned long long int>(band)+1)*this->get_units())/bands);
+ switch (mode)
+ {
+  case NEAREST_FILTER:
+  this->nearest_rows(first,last);
+  break;
+  case BILINEAR_FILTER:
+  this->bilinear_rows(first,last,lines[band]);
+  break;
+  case BOX_FILTER:
+  this->box_rows(first,last,lines[band]);
+  break;
+  case EPX_FILTER:
+  this->epx_rows(first,last);
+  break;
+ }
+
 }
 
-bool Gamepad::check_button_hold(const GAMEPAD_BUTTONS button)
+void Filter::run_band(void *target,const unsigned long int band)
 {
- return this->check_button(current,button);
+ static_cast<Filter*>(target)->scale_band(band);
 }
 
-bool Gamepad::check_button_press(const GAMEPAD_BUTTONS button)
+void Filter::resample(const FILTER_TYPE filter,unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned long int output_stride,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,const unsigned long int input_stride,Thread_Pool *pool)
 {
- bool result;
- result=false;
- if (this->check_button(current,button)==true)
+ mode=filter;
+ target=output;
+ source=input;
+ target_width=output_width;
+ target_height=output_height;
+ source_width=input_width;
+ source_height=input_height;
+ target_stride=output_stride;
+ source_stride=input_stride;
+ this->prepare_tables();
+ bands=1;
+ if (pool!=NULL)
  {
-  if (this->check_button(preversion,button)==false) result=true;
+  bands=pool->get_amount()+1;
+  if (bands>this->get_units()) bands=this->get_units();
  }
- return result;
+ if ((mode==BILINEAR_FILTER)||(mode==BOX_FILTER)) this->prepare_lines();
+ if (pool!=NULL)
+ {
+  pool->run(Filter::run_band,this,bands);
+ }
+ else
+ {
+  this->scale_band(0);
+ }
+
 }
 
-bool Gamepad::check_button_release(const GAMEPAD_BUTTONS button)
+void Filter::enlarge(unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned long int output_stride,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,const unsigned long int input_stride,Thread_Pool *pool)
 {
- bool result;
- result=false;
- if (this->check_button(current,button)==false)
+ unsigned long int width,height,stride,stage;
+ unsigned int *next;
+ const unsigned int *image;
+ width=input_width;
+ height=input_height;
+ stride=input_stride;
+ image=input;
+ stage=0;
+ while ((2*width<=output_width)&&(2*height<=output_height))
  {
-  if (this->check_button(preversion,button)==true) result=true;
+  if ((2*width==output_width)&&(2*height==output_height)) break;
+  next=this->get_stage(stage,4*static_cast<size_t>(width)*static_cast<size_t>(height));
+  this->resample(EPX_FILTER,next,2*width,2*height,2*width,image,width,height,stride,pool);
+  image=next;
+  stage=1-stage;
+  width*=2;
+  height*=2;
+  stride=width;
  }
- return result;
+ if ((2*width==output_width)&&(2*height==output_height))
+ {
+  this->resample(EPX_FILTER,output,output_width,output_height,output_stride,image,width,height,stride,pool);
+ }
+ else
+ {
+  this->resample(NEAREST_FILTER,output,output_width,output_height,output_stride,image,width,height,stride,pool);
+ }
+
 }
 
-bool Gamepad::check_trigger_hold(const GAMEPAD_TRIGGERS trigger)
+void Filter::set_kind(const FILTER_TYPE filter)
 {
- return this->check_trigger(current,trigger);
+ kind=filter;
 }
 
-bool Gamepad::check_trigger_press(const GAMEPAD_TRIGGERS trigger)
+FILTER_TYPE Filter::get_kind() const
 {
- bool result;
- result=false;
- if (this->check_trigger(current,trigger)==true)
- {
-  if (this->check_trigger(preversion,trigger)==false) result=true;
- }
- return result;
+ return kind;
 }
 
-bool Gamepad::check_trigger_release(const GAMEPAD_TRIGGERS trigger)
+void Filter::scale(unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned long int output_stride,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,const unsigned long int input_stride,Thread_Pool *pool)
 {
- bool result;
- result=false;
- if (this->check_trigger(current,trigger)==false)
+ if ((output_width>0)&&(output_height>0)&&(input_width>0)&&(input_height>0))
  {
-  if (this->check_trigger(preversion,trigger)==true) result=true;
+  if (kind==EPX_FILTER)
+  {
+   this->enlarge(output,output_width,output_height,output_stride,input,input_width,input_height,input_stride,pool);
+  }
+  else
+  {
+   this->resample(kind,output,output_width,output_height,output_stride,input,input_width,input_height,input_stride,pool);
+  }
+
  }
- return result;
+
 }
 
-unsigned char Gamepad::get_trigger(const GAMEPAD_TRIGGERS trigger) const
+void Filter::scale(unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,Thread_Pool *pool)
 {
- unsigned char result;
- result=0;
- if (trigger==GAMEPAD_LEFT_TRIGGER) result=current.Gamepad.bLeftTrigger;
- if (trigger==GAMEPAD_RIGHT_TRIGGER) result=current.Gamepad.bRightTrigger;
- return result;
+ this->scale(output,output_width,output_height,output_width,input,input_width,input_height,input_width,pool);
 }
 
-unsigned char Gamepad::get_left_trigger() const
+Frame::Frame()
 {
- return current.Gamepad.bLeftTrigger;
+ tracking=true;
+ link=create_link(this);
+ traffic=0;
+ last_traffic=0;
+ frame_width=512;
+ frame_height=512;
+ frame_stride=0;
+ frame_line=0;
+ pixels=0;
+ frame_length=0;
+ buffer=NULL;
+ shadow=NULL;
+ bands=1;
+ deferred=false;
+ commands=NULL;
+ command_amount=0;
+ command_capacity=0;
+ command_barrier=0;
+ memset(&statistics,0,sizeof(Draw_Statistics));
+ memset(&last_statistics,0,sizeof(Draw_Statistics));
+ this->select_kernels();
 }
 
-unsigned char Gamepad::get_right_trigger() const
+Frame::~Frame()
 {
- return current.Gamepad.bRightTrigger;
+ link->frame=NULL;
+ release_link(link);
+ link=NULL;
+ workers.destroy();
+ if (commands!=NULL)
+ {
+  delete[] commands;
+  commands=NULL;
+ }
+ free_aligned(buffer);
+ free_aligned(shadow);
+ buffer=NULL;
+ shadow=NULL;
 }
 
-bool Gamepad::set_vibration(const unsigned short int left,const unsigned short int right)
+void Frame::select_kernels()
 {
- this->set_motor(left,right);
- return this->write_state();
+ Processor processor;
+ transparent_kernel=draw_transparent_span;
+ fill_kernel=fill_span;
+ blending_kernel[NO_BLENDING]=copy_span;
+ blending_kernel[NORMAL_BLENDING]=blend_normal_span;
+ blending_kernel[ADDITIVE_BLENDING]=blend_additive_span;
+ blending_kernel[MULTIPLY_BLENDING]=blend_multiply_span;
+ #ifdef BLACKGDK_SSE2
+ if (processor.check_sse2()==true)
+ {
+  transparent_kernel=draw_transparent_span_sse2;
+  fill_kernel=fill_span_sse2;
+  blending_kernel[NORMAL_BLENDING]=blend_normal_span_sse2;
+  blending_kernel[ADDITIVE_BLENDING]=blend_additive_span_sse2;
+  blending_kernel[MULTIPLY_BLENDING]=blend_multiply_span_sse2;
+ }
+ #endif
+ #ifdef BLACKGDK_AVX2
+ if (processor.check_avx2()==true) transparent_kernel=draw_transparent_span_avx2;
+ #endif
 }
 
-bool Gamepad::disable_vibration()
+void Frame::calculate_buffer_length()
 {
- return this->set_vibration(0,0);
+ frame_stride=(frame_width+15)&~static_cast<unsigned long int>(15);
+ pixels=static_cast<size_t>(frame_width)*static_cast<size_t>(frame_height);
+ frame_length=static_cast<size_t>(frame_stride)*static_cast<size_t>(frame_height);
+ frame_line=frame_stride*static_cast<unsigned long int>(sizeof(unsigned int));
 }
 
-GAMEPAD_DIRECTION Gamepad::get_stick_x(const GAMEPAD_STICKS stick) const
+unsigned int *Frame::get_memory(const char *error)
 {
- GAMEPAD_DIRECTION result;
- short int control;
- result=GAMEPAD_NEUTRAL_DIRECTION;
- if (stick==GAMEPAD_LEFT_STICK)
- {
-  control=SHRT_MAX-XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE;
-  if (current.Gamepad.sThumbLX>=control) result=GAMEPAD_POSITIVE_DIRECTION;
-  if (current.Gamepad.sThumbLX<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
- }
- if (stick==GAMEPAD_RIGHT_STICK)
+ unsigned int *target;
+ target=static_cast<unsigned int*>(allocate_aligned(frame_length*sizeof(unsigned int),64));
+ if (target==NULL)
  {
-  control=SHRT_MAX-XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE;
-  if (current.Gamepad.sThumbRX>=control) result=GAMEPAD_POSITIVE_DIRECTION;
-  if (current.Gamepad.sThumbRX<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+  Halt(error);
  }
- return result;
+ return target;
 }
 
-GAMEPAD_DIRECTION Gamepad::get_stick_y(const GAMEPAD_STICKS stick) const
+void Frame::clear_buffer(unsigned int *target,const unsigned int color)
 {
- GAMEPAD_DIRECTION result;
- short int control;
- result=GAMEPAD_NEUTRAL_DIRECTION;
- if (stick==GAMEPAD_LEFT_STICK)
+ fill_kernel(target,frame_length,color);
+}
+
+unsigned int *Frame::create_buffer(const char *error)
+{
+ unsigned int *target;
+ target=NULL;
+ this->calculate_buffer_length();
+ target=this->get_memory(error);
+ this->clear_buffer(target,0);
+ return target;
+}
+
+unsigned long int Frame::clip_width(const unsigned long int x,const unsigned long int width) const
+{
+ unsigned long int result;
+ result=0;
+ if (x<frame_width)
  {
-  control=SHRT_MAX-XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE;
-  if (current.Gamepad.sThumbLY>=control) result=GAMEPAD_POSITIVE_DIRECTION;
-  if (current.Gamepad.sThumbLY<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+  result=frame_width-x;
+  if (width<result) result=width;
  }
- if (stick==GAMEPAD_RIGHT_STICK)
+ return result;
+}
+
+unsigned long int Frame::clip_height(const unsigned long int y,const unsigned long int height) const
+{
+ unsigned long int result;
+ result=0;
+ if (y<frame_height)
  {
-  control=SHRT_MAX-XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE;
-  if (current.Gamepad.sThumbRY>=control) result=GAMEPAD_POSITIVE_DIRECTION;
-  if (current.Gamepad.sThumbRY<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+  result=frame_height-y;
+  if (height<result) result=height;
  }
  return result;
 }
 
-Multimedia::Multimedia()
+void Frame::mark(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
 {
- loader=NULL;
- player=NULL;
- controler=NULL;
- video=NULL;
+ if ((width>0)&&(height>0))
+ {
+  damage.add(x,y,width,height);
+  changes.add(x,y,width,height);
+  traffic+=static_cast<size_t>(width)*static_cast<size_t>(height)*sizeof(unsigned int);
+ }
+
 }
 
-Multimedia::~Multimedia()
+Draw_Command Frame::prepare_command(const COMMAND_TYPE kind,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height) const
 {
- if (player!=NULL) player->StopWhenReady();
- if (video!=NULL) video->Release();
- if (controler!=NULL) controler->Release();
- if (player!=NULL) player->Release();
- if (loader!=NULL) loader->Release();
+ Draw_Command command;
+ command.kind=kind;
+ command.blending=NO_BLENDING;
+ command.color=0;
+ command.image=NULL;
+ command.image_width=0;
+ command.runs=NULL;
+ command.lines=NULL;
+ command.x=x;
+ command.y=y;
+ command.width=width;
+ command.height=height;
+ command.layer=0;
+ command.order=0;
+ return command;
 }
 
-void Multimedia::open(const wchar_t *target)
+void Frame::grow_commands()
 {
- player->StopWhenReady();
- if (loader->RenderFile(target,NULL)!=S_OK)
+ Draw_Command *target;
+ size_t capacity;
+ target=NULL;
+ capacity=command_capacity*2;
+ if (capacity==0) capacity=256;
+ try
  {
-  Halt("Can't load a multimedia file");
+  target=new Draw_Command[capacity];
  }
- video->put_FullScreenMode(OATRUE);
+ catch (...)
+ {
+  Halt("Can't allocate memory for draw commands");
+ }
+ if (commands!=NULL)
+ {
+  memcpy(target,commands,command_amount*sizeof(Draw_Command));
+  delete[] commands;
+ }
+ commands=target;
+ command_capacity=capacity;
 }
 
-bool Multimedia::is_play()
+bool Frame::merge_command(const Draw_Command &command)
 {
  bool result;
- long long current,total;
+ Draw_Command *last;
  result=false;
- if (controler->GetPositions(&current,&total)==S_OK)
+ if ((command_amount>0)&&(command.kind==COMMAND_FILL))
  {
-  if (current<total) result=true;
+  last=commands+command_amount-1;
+  if ((last->kind==COMMAND_FILL)&&(last->color==command.color))
+  {
+   if ((last->x==command.x)&&(last->width==command.width)&&(last->y+last->height==command.y))
+   {
+    last->height+=command.height;
+    result=true;
+   }
+   if ((result==false)&&(last->y==command.y)&&(last->height==command.height)&&(last->x+last->width==command.x))
+   {
+    last->width+=command.width;
+    result=true;
+   }
+
+  }
+
  }
  return result;
 }
 
-void Multimedia::rewind()
+bool Frame::check_cover(const Draw_Command &command) const
 {
- long long position;
- position=0;
- if (controler->SetPositions(&position,AM_SEEKING_AbsolutePositioning,NULL,AM_SEEKING_NoPositioning)!=S_OK)
+ bool result;
+ result=false;
+ if ((command.kind==COMMAND_IMAGE)||(command.kind==COMMAND_FILL)||(command.kind==COMMAND_RESTORE))
  {
-  Halt("Can't set start position");
+  result=(command.x==0)&&(command.y==0)&&(command.width==frame_width)&&(command.height==frame_height);
  }
-
+ return result;
 }
 
-void Multimedia::create_loader()
+void Frame::record(const Draw_Command &command)
 {
- if (CoCreateInstance(CLSID_FilterGraph,NULL,CLSCTX_INPROC_SERVER,IID_IGraphBuilder,reinterpret_cast<void**>(&loader))!=S_OK)
+ if (this->check_cover(command)==true)
  {
-  Halt("Can't create a multimedia loader");
+  statistics.culled+=command_amount-command_barrier;
+  command_amount=command_barrier;
+ }
+ if (this->merge_command(command)==true)
+ {
+  ++statistics.merged;
+ }
+ else
+ {
+  if (command_amount==command_capacity) this->grow_commands();
+  commands[command_amount]=command;
+  ++command_amount;
+  if (command.kind==COMMAND_SAVE) command_barrier=command_amount;
  }
 
 }
 
-void Multimedia::create_player()
+bool Frame::submit(Draw_Command &command)
 {
- if (loader->QueryInterface(IID_IMediaControl,reinterpret_cast<void**>(&player))!=S_OK)
+ bool result;
+ result=false;
+ command.width=this->clip_width(command.x,command.width);
+ command.height=this->clip_height(command.y,command.height);
+ if ((command.width>0)&&(command.height>0))
  {
-  Halt("Can't create a multimedia player");
+  ++statistics.recorded;
+  if (buffer!=NULL)
+  {
+   if (this->get_deferred()==true)
+   {
+    this->record(command);
+   }
+   else
+   {
+    this->execute(command,0,frame_height);
+    ++statistics.executed;
+   }
+
+  }
+  result=true;
+ }
+ else
+ {
+  ++statistics.culled;
  }
+ return result;
+}
+
+void Frame::sort_commands()
+{
+ unsigned long int cells[256];
+ unsigned long int layer,left,right,top,bottom,row,column;
+ size_t index;
+ memset(cells,0,sizeof(cells));
+ for (index=0;index<command_amount;++index)
+ {
+  left=static_cast<unsigned long int>(static_cast<size_t>(commands[index].x)*16/frame_width);
+  right=static_cast<unsigned long int>(static_cast<size_t>(commands[index].x+commands[index].width-1)*16/frame_width);
+  top=static_cast<unsigned long int>(static_cast<size_t>(commands[index].y)*16/frame_height);
+  bottom=static_cast<unsigned long int>(static_cast<size_t>(commands[index].y+commands[index].height-1)*16/frame_height);
+  layer=0;
+  for (row=top;row<=bottom;++row)
+  {
+   for (column=left;column<=right;++column)
+   {
+    if (cells[row*16+column]>layer) layer=cells[row*16+column];
+   }
+
+  }
+  ++layer;
+  for (row=top;row<=bottom;++row)
+  {
+   for (column=left;column<=right;++column)
+   {
+    cells[row*16+column]=layer;
+   }
 
+  }
+  commands[index].layer=layer;
+  commands[index].order=index;
+  if (layer>statistics.layers) statistics.layers=layer;
+ }
+ qsort(commands,command_amount,sizeof(Draw_Command),compare_commands);
 }
 
-void Multimedia::create_controler()
+void Frame::execute(const Draw_Command &command,const unsigned long int first,const unsigned long int last)
 {
- if (loader->QueryInterface(IID_IMediaSeeking,reinterpret_cast<void**>(&controler))!=S_OK)
+ unsigned long int row,rows,start,stop,run_x;
+ size_t index,length,position;
+ const unsigned int *image;
+ const size_t *lines;
+ start=command.y;
+ stop=command.y+command.height;
+ if (start<first) start=first;
+ if (stop>last) stop=last;
+ if (start<stop)
  {
-  Halt("Can't create a player controler");
+  rows=stop-start;
+  length=static_cast<size_t>(command.width);
+  position=this->get_offset(command.x,start);
+  image=command.image+static_cast<size_t>(start-command.y)*static_cast<size_t>(command.image_width);
+  if ((command.image==NULL)&&(command.width==frame_width))
+  {
+   length+=static_cast<size_t>(rows-1)*static_cast<size_t>(frame_stride);
+   rows=1;
+  }
+  switch (command.kind)
+  {
+   case COMMAND_IMAGE:
+   for (row=rows;row>0;--row)
+   {
+    memcpy(buffer+position,image,length*sizeof(unsigned int));
+    position+=frame_stride;
+    image+=command.image_width;
+   }
+   break;
+   case COMMAND_TRANSPARENT:
+   for (row=rows;row>0;--row)
+   {
+    transparent_kernel(buffer+position,image,length,command.color);
+    position+=frame_stride;
+    image+=command.image_width;
+   }
+   break;
+   case COMMAND_ENCODED:
+   lines=command.lines+(start-command.y);
+   position=this->get_offset(0,start);
+   for (row=0;row<rows;++row)
+   {
+    for (index=lines[row];index<lines[row+1];++index)
+    {
+     run_x=command.x+command.runs[index].offset;
+     if (run_x>=frame_width) break;
+     memcpy(buffer+position+run_x,image+command.runs[index].offset,static_cast<size_t>(this->clip_width(run_x,command.runs[index].length))*sizeof(unsigned int));
+    }
+    position+=frame_stride;
+    image+=command.image_width;
+   }
+   break;
+   case COMMAND_BLENDED:
+   for (row=rows;row>0;--row)
+   {
+    blending_kernel[command.blending](buffer+position,image,length);
+    position+=frame_stride;
+    image+=command.image_width;
+   }
+   break;
+   case COMMAND_FILL:
+   for (row=rows;row>0;--row)
+   {
+    if (length==1) buffer[position]=command.color;
+    if (length>1) fill_kernel(buffer+position,length,command.color);
+    position+=frame_stride;
+   }
+   break;
+   case COMMAND_SAVE:
+   for (row=rows;row>0;--row)
+   {
+    memcpy(shadow+position,buffer+position,length*sizeof(unsigned int));
+    position+=frame_stride;
+   }
+   break;
+   case COMMAND_RESTORE:
+   for (row=rows;row>0;--row)
+   {
+    memcpy(buffer+position,shadow+position,length*sizeof(unsigned int));
+    position+=frame_stride;
+   }
+   break;
+  }
+
  }
 
 }
 
-void Multimedia::create_video_player()
+void Frame::draw_band(const unsigned long int band)
 {
- if (loader->QueryInterface(IID_IVideoWindow,reinterpret_cast<void**>(&video))!=S_OK)
+ unsigned long int first,last,height;
+ size_t index;
+ height=(frame_height+bands-1)/bands;
+ first=band*height;
+ last=first+height;
+ if (last>frame_height) last=frame_height;
+ for (index=0;index<command_amount;++index)
  {
-  Halt("Can't create a video player");
+  this->execute(commands[index],first,last);
  }
 
 }
 
-void Multimedia::initialize()
+void Frame::run_band(void *target,const unsigned long int band)
 {
- this->create_loader();
- this->create_player();
- this->create_controler();
- this->create_video_player();
+ static_cast<Frame*>(target)->draw_band(band);
 }
 
-void Multimedia::load(const char *target)
+size_t Frame::get_offset(const unsigned long int x,const unsigned long int y,const unsigned long int target_width)
 {
- Unicode_Convertor convertor;
- this->open(convertor.convert(target));
+ return static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(target_width);
 }
 
-bool Multimedia::check_playing()
+size_t Frame::get_offset(const unsigned long int x,const unsigned long int y) const
 {
- OAFilterState state;
- bool result;
- result=false;
- if (player->GetState(INFINITE,&state)!=E_FAIL)
+ return static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(frame_stride);
+}
+
+void Frame::set_size(const unsigned long int surface_width,const unsigned long int surface_height)
+{
+ if ((surface_width==0)||(surface_height==0))
  {
-  if (state==State_Running) result=this->is_play();
+  Halt("Invalid frame size");
  }
- return result;
+ frame_width=surface_width;
+ frame_height=surface_height;
 }
 
-void Multimedia::stop()
+void Frame::set_size(const SURFACE surface)
 {
- player->StopWhenReady();
+ if (surface==SURFACE_SMALL) this->set_size(256,256);
+ if (surface==SURFACE_LARGE) this->set_size(512,512);
 }
 
-void Multimedia::play()
+void Frame::create_buffers()
 {
- this->stop();
- this->rewind();
- player->Run();
+ buffer=this->create_buffer("Can't allocate memory for render buffer");
+ shadow=this->create_buffer("Can't allocate memory for shadow buffer");
 }
 
-Memory::Memory()
+unsigned long int Frame::get_frame_line() const
 {
- memset(&memory,0,sizeof(MEMORYSTATUSEX));
- memory.dwLength=sizeof(MEMORYSTATUSEX);
+ return frame_line;
 }
 
-Memory::~Memory()
+unsigned int *Frame::get_frame_buffer()
 {
+ return buffer;
+}
 
+Thread_Pool *Frame::get_workers()
+{
+ return &workers;
 }
 
-void Memory::get_status()
+bool Frame::check_tracking() const
 {
- if (GlobalMemoryStatusEx(&memory)==FALSE)
- {
-  Halt("Can't get the memory status");
- }
+ return tracking;
+}
 
+size_t Frame::get_damage_amount() const
+{
+ return damage.get_amount();
 }
 
-unsigned long long int Memory::get_total_physical()
+Collision_Box Frame::get_damage(const size_t index) const
 {
- this->get_status();
- return memory.ullTotalPhys;
+ return damage.get_box(index);
 }
 
-unsigned long long int Memory::get_free_physical()
+void Frame::add_traffic(const size_t amount)
 {
- this->get_status();
- return memory.ullAvailPhys;
+ traffic+=amount;
 }
 
-unsigned long long int Memory::get_total_virtual()
+void Frame::clear_damage()
 {
- this->get_status();
- return memory.ullTotalVirtual;
+ tracking=true;
+ damage.clear();
+ last_traffic=traffic;
+ traffic=0;
+ last_statistics=statistics;
+ memset(&statistics,0,sizeof(Draw_Statistics));
 }
 
-unsigned long long int Memory::get_free_virtual()
+unsigned int *Frame::get_buffer()
 {
- this->get_status();
- return memory.ullAvailVirtual;
+ this->flush();
+ this->invalidate();
+ tracking=false;
+ return buffer;
 }
 
-unsigned long int Memory::get_usage()
+unsigned int *Frame::get_buffer(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
 {
- this->get_status();
- return memory.dwMemoryLoad;
+ this->flush();
+ this->mark(x,y,this->clip_width(x,width),this->clip_height(y,height));
+ return buffer;
 }
 
-System::System()
+Frame_Link *Frame::get_link()
 {
- srand(UINT_MAX);
+ return link;
 }
 
-System::~System()
+const unsigned int *Frame::read_buffer()
 {
+ this->flush();
+ return buffer;
+}
 
+size_t Frame::get_pixels() const
+{
+ return pixels;
 }
 
-unsigned long int System::get_random(const unsigned long int number)
+size_t Frame::get_traffic() const
 {
- return rand()%number;
+ return last_traffic;
 }
 
-void System::quit()
+void Frame::invalidate()
 {
- exit(EXIT_SUCCESS);
+ damage.clear();
+ changes.clear();
+ damage.add(0,0,frame_width,frame_height);
+ changes.add(0,0,frame_width,frame_height);
 }
 
-void System::run(const char *command)
+void Frame::set_threads(const unsigned long int amount)
 {
- system(command);
+ this->flush();
+ workers.destroy();
+ bands=1;
+ if (amount>1)
+ {
+  workers.create(amount-1);
+  bands=amount;
+ }
+
+}
+
+unsigned long int Frame::get_threads() const
+{
+ return bands;
+}
+
+void Frame::set_deferred(const bool enabled)
+{
+ this->flush();
+ deferred=enabled;
+}
+
+bool Frame::get_deferred() const
+{
+ return (deferred==true)||(bands>1);
+}
+
+Draw_Statistics Frame::get_statistics() const
+{
+ return last_statistics;
+}
+
+void Frame::flush()
+{
+ if (command_amount>0)
+ {
+  this->sort_commands();
+  workers.run(Frame::run_band,this,bands);
+  statistics.executed+=command_amount;
+  command_amount=0;
+ }
+ command_barrier=0;
+}
+
+bool Frame::draw_pixel(const unsigned long int x,const unsigned long int y,const unsigned int color)
+{
+ bool result;
+ size_t offset;
+ Draw_Command command;
+ result=false;
+ offset=static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(frame_width);
+ if (offset<pixels)
+ {
+  command=this->prepare_command(COMMAND_FILL,static_cast<unsigned long int>(offset%frame_width),static_cast<unsigned long int>(offset/frame_width),1,1);
+  command.color=color;
+  if ((buffer!=NULL)&&(this->get_deferred()==false))
+  {
+   buffer[this->get_offset(command.x,command.y)]=color;
+   ++statistics.recorded;
+   ++statistics.executed;
+   result=true;
+  }
+  else
+  {
+   result=this->submit(command);
+  }
+  this->mark(command.x,command.y,1,1);
+ }
+ return result;
+}
+
+bool Frame::draw_pixel(const unsigned long int x,const unsigned long int y,const unsigned long int red,const unsigned long int green,const unsigned long int blue)
+{
+ return this->draw_pixel(x,y,static_cast<unsigned int>(blue+(green<<8)+(red<<16)));
+}
+
+void Frame::draw_image(const unsigned int *image,const unsigned long int image_width,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_IMAGE,x,y,width,height);
+ command.image=image;
+ command.image_width=image_width;
+ if (this->submit(command)==true) this->mark(x,y,command.width,command.height);
+}
+
+void Frame::draw_transparent_image(const unsigned int *image,const unsigned long int image_width,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height,const unsigned int key)
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_TRANSPARENT,x,y,width,height);
+ command.image=image;
+ command.image_width=image_width;
+ command.color=key;
+ if (this->submit(command)==true) this->mark(x,y,command.width,command.height);
+}
+
+void Frame::draw_encoded_image(const unsigned int *image,const unsigned long int image_width,const Opaque_Run *runs,const size_t *lines,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_ENCODED,x,y,width,height);
+ command.image=image;
+ command.image_width=image_width;
+ command.runs=runs;
+ command.lines=lines;
+ if (this->submit(command)==true) this->mark(x,y,command.width,command.height);
+}
+
+void Frame::draw_blended_image(const unsigned int *image,const unsigned long int image_width,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height,const BLENDING_TYPE kind)
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_BLENDED,x,y,width,height);
+ command.image=image;
+ command.image_width=image_width;
+ command.blending=kind;
+ if (this->submit(command)==true) this->mark(x,y,command.width,command.height);
+}
+
+void Frame::clear_screen()
+{
+ this->clear_screen(0);
+}
+
+void Frame::clear_screen(const unsigned int color)
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_FILL,0,0,frame_width,frame_height);
+ command.color=color;
+ if (this->submit(command)==true) this->mark(0,0,frame_width,frame_height);
+}
+
+void Frame::clear_screen(const unsigned char red,const unsigned char green,const unsigned char blue)
+{
+ this->clear_screen(static_cast<unsigned int>(blue)+(static_cast<unsigned int>(green)<<8)+(static_cast<unsigned int>(red)<<16));
+}
+
+void Frame::save()
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_SAVE,0,0,frame_width,frame_height);
+ this->submit(command);
+ changes.clear();
+ traffic+=pixels*sizeof(unsigned int);
+}
+
+void Frame::swap()
+{
+ unsigned int *target;
+ this->flush();
+ target=buffer;
+ buffer=shadow;
+ shadow=target;
+ this->invalidate();
+}
+
+void Frame::restore()
+{
+ size_t index;
+ Collision_Box target;
+ if (tracking==true)
+ {
+  for (index=0;index<changes.get_amount();++index)
+  {
+   target=changes.get_box(index);
+   this->restore(target.x,target.y,target.width,target.height);
+  }
+
+ }
+ else
+ {
+  this->restore(0,0,frame_width,frame_height);
+ }
+ changes.clear();
+}
+
+void Frame::restore(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+{
+ Draw_Command command;
+ command=this->prepare_command(COMMAND_RESTORE,x,y,width,height);
+ if (this->submit(command)==true)
+ {
+  damage.add(x,y,command.width,command.height);
+  traffic+=static_cast<size_t>(command.width)*static_cast<size_t>(command.height)*sizeof(unsigned int);
+ }
+
+}
+
+void Frame::restore(const Collision_Box *targets,const size_t amount)
+{
+ size_t index;
+ Region region;
+ Collision_Box target;
+ for (index=0;index<amount;++index)
+ {
+  target=targets[index];
+  target.width=this->clip_width(target.x,target.width);
+  target.height=this->clip_height(target.y,target.height);
+  if ((target.width>0)&&(target.height>0)) region.add(target);
+ }
+ for (index=0;index<region.get_amount();++index)
+ {
+  target=region.get_box(index);
+  this->restore(target.x,target.y,target.width,target.height);
+ }
+
+}
+
+unsigned long int Frame::get_frame_width() const
+{
+ return frame_width;
+}
+
+unsigned long int Frame::get_frame_stride() const
+{
+ return frame_stride;
+}
+
+unsigned long int Frame::get_frame_height() const
+{
+ return frame_height;
+}
+
+Plane::Plane()
+{
+ target=NULL;
+ target_frame=NULL;
+ plane=NULL;
+ target_width=0;
+ target_height=0;
+ target_stride=0;
+ x_ratio=0;
+ y_ratio=0;
+ columns=NULL;
+ rows=NULL;
+ scale=1;
+ scale_kernel=NULL;
+}
+
+Plane::~Plane()
+{
+ this->destroy_tables();
+}
+
+void Plane::destroy_tables()
+{
+ if (columns!=NULL)
+ {
+  delete[] columns;
+  columns=NULL;
+ }
+ if (rows!=NULL)
+ {
+  delete[] rows;
+  rows=NULL;
+ }
+
+}
+
+unsigned long int *Plane::create_table(const unsigned long int length,const float ratio)
+{
+ unsigned long int index;
+ unsigned long int *table;
+ table=NULL;
+ try
+ {
+  table=new unsigned long int[length];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for plane scaling table");
+ }
+ for (index=0;index<length;++index)
+ {
+  table[index]=ratio*static_cast<float>(index);
+ }
+ return table;
+}
+
+void Plane::select_scale()
+{
+ Processor processor;
+ unsigned long int index;
+ scale=1;
+ if (this->get_frame_width()>0) scale=target_width/this->get_frame_width();
+ if ((scale<2)||(scale>4)) scale=1;
+ for (index=0;index<target_width;++index)
+ {
+  if (columns[index]!=index/scale) scale=1;
+ }
+ scale_kernel=double_span;
+ if (scale==3) scale_kernel=triple_span;
+ if (scale==4) scale_kernel=quadruple_span;
+ #ifdef BLACKGDK_SSE2
+ if (processor.check_sse2()==true)
+ {
+  scale_kernel=double_span_sse2;
+  if (scale==3) scale_kernel=triple_span_sse2;
+  if (scale==4) scale_kernel=quadruple_span_sse2;
+ }
+ #endif
+}
+
+void Plane::prepare_plane(const unsigned long int width,const unsigned long int height,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_stride,unsigned int *surface_buffer)
+{
+ this->set_size(width,height);
+ this->create_buffers();
+ plane=this->get_frame_buffer();
+ target=surface_buffer;
+ target_width=surface_width;
+ target_height=surface_height;
+ target_stride=surface_stride;
+ x_ratio=static_cast<float>(width)/static_cast<float>(surface_width);
+ y_ratio=static_cast<float>(height)/static_cast<float>(surface_height);
+ this->destroy_tables();
+ columns=this->create_table(target_width,x_ratio);
+ rows=this->create_table(target_height,y_ratio);
+ this->select_scale();
+}
+
+void Plane::create_plane(const unsigned long int width,const unsigned long int height,const unsigned long int surface_width,const unsigned long int surface_height,unsigned int *surface_buffer)
+{
+ this->prepare_plane(width,height,surface_width,surface_height,surface_width,surface_buffer);
+ target_frame=NULL;
+}
+
+void Plane::create_plane(const unsigned long int width,const unsigned long int height,Frame *surface)
+{
+ this->prepare_plane(width,height,surface->get_frame_width(),surface->get_frame_height(),surface->get_frame_stride(),NULL);
+ target_frame=surface;
+}
+
+void Plane::set_filter(const FILTER_TYPE kind)
+{
+ filter.set_kind(kind);
+}
+
+FILTER_TYPE Plane::get_filter() const
+{
+ return filter.get_kind();
+}
+
+void Plane::scale_rows()
+{
+ unsigned long int y;
+ size_t done;
+ unsigned int *output;
+ const unsigned int *input;
+ output=target;
+ for (y=0;y<target_height;++y)
+ {
+  if ((y>0)&&(rows[y]==rows[y-1]))
+  {
+   memcpy(output,output-target_stride,static_cast<size_t>(target_width)*sizeof(unsigned int));
+  }
+  else
+  {
+   input=plane+this->get_offset(0,rows[y]);
+   done=0;
+   if (scale>1)
+   {
+    done=target_width/scale;
+    scale_kernel(output,input,done);
+    done*=scale;
+   }
+   scale_span(output+done,input,columns+done,target_width-done);
+  }
+  output+=target_stride;
+ }
+
+}
+
+void Plane::transfer()
+{
+ this->flush();
+ plane=this->get_frame_buffer();
+ if (target_frame!=NULL)
+ {
+  target=target_frame->get_buffer(0,0,target_width,target_height);
+  target_stride=target_frame->get_frame_stride();
+ }
+ if (filter.get_kind()==NEAREST_FILTER)
+ {
+  this->scale_rows();
+ }
+ else
+ {
+  filter.scale(target,target_width,target_height,target_stride,plane,this->get_frame_width(),this->get_frame_height(),this->get_frame_stride(),this->get_workers());
+ }
+
+}
+
+Plane* Plane::get_handle()
+{
+ return this;
+}
+
+Timer::Timer()
+{
+ interval=0;
+ start=clock.get_time();
+}
+
+Timer::~Timer()
+{
+
+}
+
+void Timer::set_timer(const unsigned long int seconds)
+{
+ interval=static_cast<unsigned long long int>(seconds)*1000000000ULL;
+ start=clock.get_time();
+}
+
+bool Timer::check_timer()
+{
+ bool result;
+ unsigned long long int now;
+ result=false;
+ now=clock.get_time();
+ if (now-start>=interval)
+ {
+  result=true;
+  start=now;
+ }
+ return result;
+}
+
+FPS::FPS()
+{
+ timer.set_timer(1);
+ current=0;
+ fps=0;
+}
+
+FPS::~FPS()
+{
+
+}
+
+void FPS::update_counter()
+{
+ ++current;
+ if (timer.check_timer()==true)
+ {
+  fps=current;
+  current=0;
+ }
+
+}
+
+unsigned long int FPS::get_fps() const
+{
+ return fps;
+}
+
+Simulation::Simulation()
+{
+ step=1000000000ULL/60;
+ accumulator=0;
+ last=clock.get_time();
+ limit=5;
+ dropped=0;
+}
+
+Simulation::~Simulation()
+{
+
+}
+
+void Simulation::set_rate(const unsigned long int rate)
+{
+ if (rate>0) step=1000000000ULL/rate;
+}
+
+void Simulation::set_limit(const unsigned long int amount)
+{
+ limit=amount;
+}
+
+void Simulation::start()
+{
+ accumulator=0;
+ dropped=0;
+ last=clock.get_time();
+}
+
+unsigned long int Simulation::update()
+{
+ unsigned long long int now,amount;
+ now=clock.get_time();
+ accumulator+=now-last;
+ last=now;
+ amount=accumulator/step;
+ accumulator%=step;
+ if (limit>0)
+ {
+  if (amount>limit)
+  {
+   dropped+=static_cast<unsigned long int>(amount-limit);
+   amount=limit;
+  }
+
+ }
+ return static_cast<unsigned long int>(amount);
+}
+
+double Simulation::get_alpha() const
+{
+ return static_cast<double>(accumulator)/static_cast<double>(step);
+}
+
+double Simulation::get_delta() const
+{
+ return static_cast<double>(step)/1000000000.0;
+}
+
+unsigned long int Simulation::get_dropped() const
+{
+ return dropped;
+}
+
+Profiler::Profiler()
+{
+ records=NULL;
+ samples=NULL;
+ capacity=0;
+ amount=0;
+ position=0;
+ frames=0;
+ this->reset_record();
+}
+
+Profiler::~Profiler()
+{
+ this->destroy_storage();
+}
+
+unsigned long long int *Profiler::create_samples(const size_t length)
+{
+ unsigned long long int *target;
+ target=NULL;
+ try
+ {
+  target=new unsigned long long int[length];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for profiler samples");
+ }
+ return target;
+}
+
+Profile_Record *Profiler::create_records(const size_t length)
+{
+ Profile_Record *target;
+ target=NULL;
+ try
+ {
+  target=new Profile_Record[length];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for profiler records");
+ }
+ return target;
+}
+
+void Profiler::destroy_storage()
+{
+ if (records!=NULL)
+ {
+  delete[] records;
+  records=NULL;
+ }
+ if (samples!=NULL)
+ {
+  delete[] samples;
+  samples=NULL;
+ }
+
+}
+
+void Profiler::reset_record()
+{
+ size_t index;
+ current.start=0;
+ current.length=0;
+ for (index=0;index<5;++index)
+ {
+  current.phase_start[index]=0;
+  current.phase_length[index]=0;
+  opened[index]=0;
+ }
+
+}
+
+Profile_Record Profiler::get_record(const size_t index) const
+{
+ return records[(position+capacity-amount+index)%capacity];
+}
+
+Profile_Statistics Profiler::calculate()
+{
+ Profile_Statistics result;
+ unsigned long long int total;
+ size_t index;
+ result.average=0;
+ result.median=0;
+ result.percentile_95=0;
+ result.percentile_99=0;
+ result.maximum=0;
+ if (amount>0)
+ {
+  total=0;
+  qsort(samples,amount,sizeof(unsigned long long int),compare_samples);
+  for (index=0;index<amount;++index)
+  {
+   total+=samples[index];
+  }
+  result.average=total/amount;
+  result.median=samples[((amount-1)*50)/100];
+  result.percentile_95=samples[((amount-1)*95)/100];
+  result.percentile_99=samples[((amount-1)*99)/100];
+  result.maximum=samples[amount-1];
+ }
+ return result;
+}
+
+void Profiler::write_text(Output_File &target,const char *text)
+{
+ target.write(const_cast<char*>(text),strlen(text));
+}
+
+void Profiler::set_window(const size_t length)
+{
+ if (length>0)
+ {
+  this->destroy_storage();
+  records=this->create_records(length);
+  samples=this->create_samples(length);
+  capacity=length;
+  amount=0;
+  position=0;
+ }
+
+}
+
+size_t Profiler::get_window() const
+{
+ return capacity;
+}
+
+void Profiler::begin_zone(const PROFILE_PHASE phase)
+{
+ unsigned long long int now;
+ now=clock.get_time();
+ if (current.start==0) current.start=now;
+ if (current.phase_start[phase]==0) current.phase_start[phase]=now;
+ opened[phase]=now;
+}
+
+void Profiler::end_zone(const PROFILE_PHASE phase)
+{
+ if (opened[phase]>0)
+ {
+  current.phase_length[phase]+=clock.get_time()-opened[phase];
+  opened[phase]=0;
+ }
+
+}
+
+void Profiler::next_frame()
+{
+ unsigned long long int now;
+ now=clock.get_time();
+ if (records==NULL) this->set_window(512);
+ if (current.start>0)
+ {
+  current.length=now-current.start;
+  records[position]=current;
+  position=(position+1)%capacity;
+  if (amount<capacity) ++amount;
+  ++frames;
+ }
+ this->reset_record();
+ current.start=now;
+}
+
+size_t Profiler::get_amount() const
+{
+ return amount;
+}
+
+unsigned long int Profiler::get_frames() const
+{
+ return frames;
+}
+
+Profile_Statistics Profiler::get_frame_statistics()
+{
+ size_t index;
+ for (index=0;index<amount;++index)
+ {
+  samples[index]=this->get_record(index).length;
+ }
+ return this->calculate();
+}
+
+Profile_Statistics Profiler::get_phase_statistics(const PROFILE_PHASE phase)
+{
+ size_t index;
+ for (index=0;index<amount;++index)
+ {
+  samples[index]=this->get_record(index).phase_length[phase];
+ }
+ return this->calculate();
+}
+
+void Profiler::save_csv(const char *name)
+{
+ Output_File target;
+ Profile_Record record;
+ unsigned long long int origin;
+ unsigned long int first;
+ size_t index;
+ char text[256];
+ target.open(name);
+ this->write_text(target,"frame,start,length,input,update,draw,present,wait\n");
+ first=frames-static_cast<unsigned long int>(amount);
+ origin=0;
+ if (amount>0) origin=this->get_record(0).start;
+ for (index=0;index<amount;++index)
+ {
+  record=this->get_record(index);
+  sprintf(text,"%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",first+static_cast<unsigned long int>(index),get_microseconds(record.start-origin),get_microseconds(record.length),get_microseconds(record.phase_length[PROFILE_INPUT]),get_microseconds(record.phase_length[PROFILE_UPDATE]),get_microseconds(record.phase_length[PROFILE_DRAW]),get_microseconds(record.phase_length[PROFILE_PRESENT]),get_microseconds(record.phase_length[PROFILE_WAIT]));
+  this->write_text(target,text);
+ }
+ target.close();
+}
+
+void Profiler::save_trace(const char *name)
+{
+ Output_File target;
+ Profile_Record record;
+ unsigned long long int origin;
+ unsigned long int first;
+ size_t index,phase;
+ const char *separator;
+ const char *names[5]={"input","update","draw","present","wait"};
+ char text[256];
+ target.open(name);
+ this->write_text(target,"{\"traceEvents\":[\n");
+ first=frames-static_cast<unsigned long int>(amount);
+ origin=0;
+ if (amount>0) origin=this->get_record(0).start;
+ separator="";
+ for (index=0;index<amount;++index)
+ {
+  record=this->get_record(index);
+  sprintf(text,"%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lu}}",separator,get_microseconds(record.start-origin),get_microseconds(record.length),first+static_cast<unsigned long int>(index));
+  this->write_text(target,text);
+  separator=",\n";
+  for (phase=0;phase<5;++phase)
+  {
+   if (record.phase_length[phase]>0)
+   {
+    sprintf(text,"%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",separator,names[phase],get_microseconds(record.phase_start[phase]-origin),get_microseconds(record.phase_length[phase]));
+    this->write_text(target,text);
+   }
+
+  }
+
+ }
+ this->write_text(target,"\n],\"displayTimeUnit\":\"ms\"}\n");
+ target.close();
+}
+
+Profiler* Profiler::get_handle()
+{
+ return this;
+}
+
+Profile_Zone::Profile_Zone(Profiler *target,const PROFILE_PHASE kind)
+{
+ profiler=target;
+ phase=kind;
+ if (profiler!=NULL) profiler->begin_zone(phase);
+}
+
+Profile_Zone::~Profile_Zone()
+{
+ if (profiler!=NULL) profiler->end_zone(phase);
+}
+
+Unicode_Convertor::Unicode_Convertor()
+{
+ target=NULL;
+}
+
+Unicode_Convertor::~Unicode_Convertor()
+{
+ if (target!=NULL) delete[] target;
+}
+
+void Unicode_Convertor::get_memory(const size_t length)
+{
+ try
+ {
+  target=new wchar_t[length+1];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory");
+ }
+
+}
+
+void Unicode_Convertor::clear_buffer(const size_t length)
+{
+ size_t index,stop;
+ stop=length+1;
+ for (index=0;index<stop;++index)
+ {
+  target[index]=0;
+ }
+
+}
+
+void Unicode_Convertor::create_buffer(const size_t length)
+{
+ this->get_memory(length);
+ this->clear_buffer(length);
+}
+
+void Unicode_Convertor::convert_string(const char *source)
+{
+ size_t index,length;
+ length=strlen(source);
+ for (index=0;index<length;++index)
+ {
+  target[index]=btowc(source[index]);
+ }
+
+}
+
+wchar_t *Unicode_Convertor::convert(const char *source)
+{
+ this->create_buffer(strlen(source));
+ this->convert_string(source);
+ return target;
+}
+
+Presenter::Presenter()
+{
+
+}
+
+Presenter::~Presenter()
+{
+
+}
+
+Direct2D_Presenter::Direct2D_Presenter()
+{
+ render=NULL;
+ target=NULL;
+ surface=NULL;
+ buffer=NULL;
+ line=0;
+ source=D2D1::RectU(0,0,0,0);
+ destanation=D2D1::RectF(0,0,0,0);
+ texture=D2D1::RectF(0,0,0,0);
+ setting.dpiX=0;
+ setting.dpiY=0;
+ setting.type=D2D1_RENDER_TARGET_TYPE_HARDWARE;
+ setting.pixelFormat=D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM,D2D1_ALPHA_MODE_IGNORE);
+ setting.usage=D2D1_RENDER_TARGET_USAGE_NONE;
+ setting.minLevel=D2D1_FEATURE_LEVEL_9;
+ configuration.hwnd=NULL;
+ configuration.pixelSize=D2D1::SizeU(0,0);
+ configuration.presentOptions=D2D1_PRESENT_OPTIONS_IMMEDIATELY;
+}
+
+Direct2D_Presenter::~Direct2D_Presenter()
+{
+ if (surface!=NULL) surface->Release();
+ if (target!=NULL) target->Release();
+ if (render!=NULL) render->Release();
+}
+
+void Direct2D_Presenter::create_factory()
+{
+ if (render==NULL)
+ {
+  if (D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED,&render)!=S_OK)
+  {
+   Halt("Can't create render");
+  }
+
+ }
+
+}
+
+void Direct2D_Presenter::create_target()
+{
+ if (render->CreateHwndRenderTarget(setting,configuration,&target)!=S_OK)
+ {
+  Halt("Can't create render target");
+ }
+ target->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+}
+
+void Direct2D_Presenter::create_surface()
+{
+ if (target->CreateBitmap(D2D1::SizeU(source.right,source.bottom),buffer,line,D2D1::BitmapProperties(setting.pixelFormat,96.0,96.0),&surface)!=S_OK)
+ {
+  Halt("Can't create render surface");
+ }
+
+}
+
+void Direct2D_Presenter::destroy_resource()
+{
+ if (surface!=NULL)
+ {
+  surface->Release();
+  surface=NULL;
+ }
+ if (target!=NULL)
+ {
+  target->Release();
+  target=NULL;
+ }
+
+}
+
+void Direct2D_Presenter::recreate_render()
+{
+ this->destroy_resource();
+ this->create_target();
+ this->create_surface();
+}
+
+void Direct2D_Presenter::create(HWND handle,const unsigned long int window_width,const unsigned long int window_height,const unsigned int *surface_buffer,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_line)
+{
+ buffer=surface_buffer;
+ line=surface_line;
+ configuration.hwnd=handle;
+ configuration.pixelSize=D2D1::SizeU(window_width,window_height);
+ source=D2D1::RectU(0,0,surface_width,surface_height);
+ destanation=D2D1::RectF(0,0,window_width,window_height);
+ texture=D2D1::RectF(0,0,surface_width,surface_height);
+ this->create_factory();
+ this->create_target();
+ this->create_surface();
+}
+
+void Direct2D_Presenter::destroy()
+{
+ this->destroy_resource();
+}
+
+void Direct2D_Presenter::set_buffer(const unsigned int *surface_buffer)
+{
+ buffer=surface_buffer;
+}
+
+size_t Direct2D_Presenter::upload(const Collision_Box &target)
+{
+ D2D1_RECT_U area;
+ area=D2D1::RectU(target.x,target.y,target.x+target.width,target.y+target.height);
+ surface->CopyFromMemory(&area,buffer+static_cast<size_t>(target.y)*static_cast<size_t>(line/sizeof(unsigned int))+static_cast<size_t>(target.x),line);
+ return static_cast<size_t>(target.width)*static_cast<size_t>(target.height)*sizeof(unsigned int);
+}
+
+size_t Direct2D_Presenter::upload()
+{
+ surface->CopyFromMemory(&source,buffer,line);
+ return static_cast<size_t>(source.right)*static_cast<size_t>(source.bottom)*sizeof(unsigned int);
+}
+
+bool Direct2D_Presenter::present()
+{
+ bool result;
+ result=true;
+ target->BeginDraw();
+ target->DrawBitmap(surface,destanation,1.0,D2D1_BITMAP_INTERPOLATION_MODE_LINEAR,texture);
+ if (target->EndDraw()==(HRESULT)D2DERR_RECREATE_TARGET)
+ {
+  this->recreate_render();
+  result=false;
+ }
+ return result;
+}
+
+GDI_Presenter::GDI_Presenter()
+{
+ window=NULL;
+ context=NULL;
+ buffer=NULL;
+ width=0;
+ height=0;
+ frame_width=0;
+ frame_height=0;
+ memset(&setting,0,sizeof(BITMAPINFO));
+}
+
+GDI_Presenter::~GDI_Presenter()
+{
+ if (context!=NULL) ReleaseDC(window,context);
+}
+
+void GDI_Presenter::set_setting(const unsigned long int surface_line)
+{
+ setting.bmiHeader.biSize=sizeof(BITMAPINFOHEADER);
+ setting.bmiHeader.biWidth=static_cast<LONG>(surface_line/sizeof(unsigned int));
+ setting.bmiHeader.biHeight=-static_cast<LONG>(frame_height);
+ setting.bmiHeader.biPlanes=1;
+ setting.bmiHeader.biBitCount=32;
+ setting.bmiHeader.biCompression=BI_RGB;
+}
+
+void GDI_Presenter::create(HWND handle,const unsigned long int window_width,const unsigned long int window_height,const unsigned int *surface_buffer,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_line)
+{
+ window=handle;
+ buffer=surface_buffer;
+ width=window_width;
+ height=window_height;
+ frame_width=surface_width;
+ frame_height=surface_height;
+ this->set_setting(surface_line);
+ context=GetDC(window);
+ if (context==NULL)
+ {
+  Halt("Can't get device context");
+ }
+ SetStretchBltMode(context,COLORONCOLOR);
+}
+
+void GDI_Presenter::destroy()
+{
+ if (context!=NULL)
+ {
+  ReleaseDC(window,context);
+  context=NULL;
+ }
+
+}
+
+void GDI_Presenter::set_buffer(const unsigned int *surface_buffer)
+{
+ buffer=surface_buffer;
+}
+
+size_t GDI_Presenter::upload(const Collision_Box &)
+{
+ return 0;
+}
+
+size_t GDI_Presenter::upload()
+{
+ return 0;
+}
+
+bool GDI_Presenter::present()
+{
+ if (StretchDIBits(context,0,0,width,height,0,0,frame_width,frame_height,buffer,&setting,DIB_RGB_COLORS,SRCCOPY)==0)
+ {
+  Halt("Can't present the frame");
+ }
+ return true;
+}
+
+Render::Render()
+{
+ unsigned long int index;
+ presenter=&direct2d;
+ ready=false;
+ pipeline=false;
+ thread=NULL;
+ signal=NULL;
+ stopping=0;
+ published=0;
+ back=0;
+ front=0;
+ for (index=0;index<3;++index)
+ {
+  slots[index]=NULL;
+ }
+
+}
+
+Render::~Render()
+{
+ this->stop_pipeline();
+ if (ready==true) presenter->destroy();
+}
+
+void Render::start_presenter()
+{
+ presenter->create(this->get_window(),this->get_width(),this->get_height(),this->get_frame_buffer(),this->get_frame_width(),this->get_frame_height(),this->get_frame_line());
+ this->invalidate();
+}
+
+void Render::change_presenter(Presenter *target)
+{
+ if (target!=NULL)
+ {
+  if (ready==true)
+  {
+   this->stop_pipeline();
+   presenter->destroy();
+   presenter=target;
+   this->start_presenter();
+   if (pipeline==true) this->start_pipeline();
+  }
+  else
+  {
+   presenter=target;
+  }
+
+ }
+
+}
+
+unsigned int *Render::create_slot()
+{
+ unsigned int *target;
+ size_t length;
+ target=NULL;
+ length=static_cast<size_t>(this->get_frame_line()/sizeof(unsigned int))*static_cast<size_t>(this->get_frame_height());
+ try
+ {
+  target=new unsigned int[length];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for frame slot");
+ }
+ memcpy(target,this->get_frame_buffer(),length*sizeof(unsigned int));
+ return target;
+}
+
+void Render::copy_slot(const Collision_Box &target)
+{
+ unsigned long int row;
+ size_t offset,length;
+ length=static_cast<size_t>(target.width)*sizeof(unsigned int);
+ for (row=0;row<target.height;++row)
+ {
+  offset=this->get_offset(target.x,target.y+row);
+  memcpy(slots[back]+offset,this->get_frame_buffer()+offset,length);
+ }
+ this->add_traffic(length*static_cast<size_t>(target.height));
+}
+
+void Render::fill_slot()
+{
+ size_t index;
+ unsigned long int slot;
+ if (this->check_tracking()==true)
+ {
+  for (index=0;index<this->get_damage_amount();++index)
+  {
+   for (slot=0;slot<3;++slot)
+   {
+    pending[slot].add(this->get_damage(index));
+   }
+
+  }
+
+ }
+ else
+ {
+  for (slot=0;slot<3;++slot)
+  {
+   pending[slot].clear();
+   pending[slot].add(0,0,this->get_frame_width(),this->get_frame_height());
+  }
+
+ }
+ for (index=0;index<pending[back].get_amount();++index)
+ {
+  this->copy_slot(pending[back].get_box(index));
+ }
+ pending[back].clear();
+}
+
+void Render::publish_slot()
+{
+ LONG previous;
+ previous=InterlockedExchange(&published,static_cast<LONG>(back|4));
+ back=static_cast<unsigned long int>(previous&3);
+ SetEvent(signal);
+}
+
+void Render::present_slot()
+{
+ LONG previous;
+ if ((InterlockedCompareExchange(&published,0,0)&4)!=0)
+ {
+  previous=InterlockedExchange(&published,static_cast<LONG>(front));
+  front=static_cast<unsigned long int>(previous&3);
+  presenter->set_buffer(slots[front]);
+  presenter->upload();
+  presenter->present();
+ }
+
+}
+
+DWORD WINAPI Render::present_frames(LPVOID target)
+{
+ Render *render;
+ render=static_cast<Render*>(target);
+ while (InterlockedCompareExchange(&render->stopping,0,0)==0)
+ {
+  WaitForSingleObject(render->signal,INFINITE);
+  render->present_slot();
+ }
+ return 0;
+}
+
+void Render::start_pipeline()
+{
+ unsigned long int index;
+ this->flush();
+ for (index=0;index<3;++index)
+ {
+  slots[index]=this->create_slot();
+  pending[index].clear();
+ }
+ back=0;
+ published=1;
+ front=2;
+ stopping=0;
+ signal=CreateEvent(NULL,FALSE,FALSE,NULL);
+ if (signal==NULL)
+ {
+  Halt("Can't create synchronization objects for render thread");
+ }
+ thread=CreateThread(NULL,0,Render::present_frames,this,0,NULL);
+ if (thread==NULL)
+ {
+  Halt("Can't create render thread");
+ }
+
+}
+
+void Render::stop_pipeline()
+{
+ unsigned long int index;
+ if (thread!=NULL)
+ {
+  InterlockedExchange(&stopping,1);
+  SetEvent(signal);
+  WaitForSingleObject(thread,INFINITE);
+  CloseHandle(thread);
+  CloseHandle(signal);
+  thread=NULL;
+  signal=NULL;
+  for (index=0;index<3;++index)
+  {
+   delete[] slots[index];
+   slots[index]=NULL;
+  }
+  presenter->set_buffer(this->get_frame_buffer());
+  this->invalidate();
+ }
+
+}
+
+void Render::create_render()
+{
+ this->create_buffers();
+ this->start_presenter();
+ ready=true;
+ if (pipeline==true) this->start_pipeline();
+}
+
+void Render::refresh()
+{
+ size_t index;
+ this->flush();
+ if (thread!=NULL)
+ {
+  this->fill_slot();
+  this->clear_damage();
+  this->publish_slot();
+ }
+ else
+ {
+  presenter->set_buffer(this->get_frame_buffer());
+  if (this->check_tracking()==true)
+  {
+   for (index=0;index<this->get_damage_amount();++index)
+   {
+    this->add_traffic(presenter->upload(this->get_damage(index)));
+   }
+
+  }
+  else
+  {
+   this->add_traffic(presenter->upload());
+  }
+  this->clear_damage();
+  if (presenter->present()==false) this->invalidate();
+ }
+
+}
+
+void Render::set_presenter(const PRESENTER_TYPE kind)
+{
+ if (kind==GDI_PRESENTER)
+ {
+  this->change_presenter(&gdi);
+ }
+ else
+ {
+  this->change_presenter(&direct2d);
+ }
+
+}
+
+void Render::set_presenter(Presenter *target)
+{
+ this->change_presenter(target);
+}
+
+Presenter* Render::get_presenter()
+{
+ return presenter;
+}
+
+void Render::set_pipeline(const bool enabled)
+{
+ pipeline=enabled;
+ if (ready==true)
+ {
+  this->stop_pipeline();
+  if (pipeline==true) this->start_pipeline();
+ }
+
+}
+
+bool Render::get_pipeline() const
+{
+ return pipeline;
+}
+
+Screen::Screen()
+{
+ profiler=NULL;
+}
+
+Screen::~Screen()
+{
+
+}
+
+void Screen::initialize()
+{
+ this->prepare_engine();
+ this->create_buffers();
+ this->create_timer();
+ this->create_window();
+ this->capture_mouse();
+ this->create_render();
+ this->start_timer();
+}
+
+void Screen::initialize(const SURFACE surface)
+{
+ this->set_size(surface);
+ this->initialize();
+}
+
+void Screen::initialize(const unsigned long int width,const unsigned long int height)
+{
+ this->set_size(width,height);
+ this->initialize();
+}
+
+void Screen::present_frame()
+{
+ Profile_Zone zone(profiler,PROFILE_PRESENT);
+ this->refresh();
+}
+
+void Screen::wait_frame()
+{
+ Profile_Zone zone(profiler,PROFILE_WAIT);
+ this->wait_timer();
+}
+
+bool Screen::update()
+{
+ bool run;
+ this->present_frame();
+ this->update_counter();
+ run=this->process_message();
+ if (profiler!=NULL) profiler->next_frame();
+ return run;
+}
+
+bool Screen::sync()
+{
+ bool run;
+ this->present_frame();
+ this->update_counter();
+ run=this->process_message();
+ this->wait_frame();
+ if (profiler!=NULL) profiler->next_frame();
+ return run;
+}
+
+void Screen::set_profiler(Profiler *target)
+{
+ profiler=target;
+}
+
+Screen* Screen::get_handle()
+{
+ return this;
+}
+
+Offscreen::Offscreen()
+{
+ clock=0;
+ start=0;
+ interval=0;
+ frames=0;
+ limit=0;
+ profiler=NULL;
+}
+
+Offscreen::~Offscreen()
+{
+
+}
+
+unsigned long long int Offscreen::get_counter() const
+{
+ return counter.get_time()/1000;
+}
+
+void Offscreen::advance_clock()
+{
+ if (interval>0)
+ {
+  clock+=interval;
+ }
+ else
+ {
+  clock=this->get_counter()-start;
+ }
+
+}
+
+void Offscreen::initialize()
+{
+ this->create_buffers();
+ clock=0;
+ frames=0;
+ start=this->get_counter();
+}
+
+void Offscreen::initialize(const SURFACE surface)
+{
+ this->set_size(surface);
+ this->initialize();
+}
+
+void Offscreen::initialize(const unsigned long int width,const unsigned long int height)
+{
+ this->set_size(width,height);
+ this->initialize();
+}
+
+void Offscreen::set_clock(const unsigned long int step)
+{
+ interval=step;
+}
+
+void Offscreen::set_limit(const unsigned long int amount)
+{
+ limit=amount;
+}
+
+unsigned long long int Offscreen::get_clock() const
+{
+ return clock;
+}
+
+unsigned long int Offscreen::get_frames() const
+{
+ return frames;
+}
+
+unsigned long long int Offscreen::get_checksum()
+{
+ unsigned long long int result;
+ unsigned long int x,y;
+ unsigned int *target;
+ result=14695981039346656037ULL;
+ this->flush();
+ target=this->get_frame_buffer();
+ for (y=0;y<this->get_frame_height();++y)
+ {
+  for (x=0;x<this->get_frame_width();++x)
+  {
+   result^=target[x];
+   result*=1099511628211ULL;
+  }
+  target+=this->get_frame_stride();
+ }
+ return result;
+}
+
+void Offscreen::present_frame()
+{
+ Profile_Zone zone(profiler,PROFILE_PRESENT);
+ this->flush();
+ this->clear_damage();
+}
+
+bool Offscreen::update()
+{
+ this->present_frame();
+ this->update_counter();
+ this->advance_clock();
+ ++frames;
+ if (profiler!=NULL) profiler->next_frame();
+ return (limit==0)||(frames<limit);
+}
+
+bool Offscreen::sync()
+{
+ return this->update();
+}
+
+void Offscreen::set_profiler(Profiler *target)
+{
+ profiler=target;
+}
+
+Offscreen* Offscreen::get_handle()
+{
+ return this;
+}
+
+Keyboard::Keyboard()
+{
+ preversion=NULL;
+}
+
+Keyboard::~Keyboard()
+{
+ if (preversion!=NULL)
+ {
+  delete[] preversion;
+  preversion=NULL;
+ }
+
+}
+
+void Keyboard::create_buffer()
+{
+ try
+ {
+  preversion=new unsigned char[KEYBOARD];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for keyboard state buffer");
+ }
+
+}
+
+void Keyboard::clear_buffer()
+{
+ size_t index;
+ for (index=0;index<KEYBOARD;++index)
+ {
+  preversion[index]=KEY_RELEASE;
+ }
+
+}
+
+bool Keyboard::check_state(const unsigned char code,const unsigned char state)
+{
+ bool result;
+ result=false;
+ if (Keys[code]==state)
+ {
+  if (preversion[code]!=state) result=true;
+ }
+ preversion[code]=Keys[code];
+ return result;
+}
+
+void Keyboard::initialize()
+{
+ this->create_buffer();
+ this->clear_buffer();
+}
+
+bool Keyboard::check_hold(const unsigned char code)
+{
+ bool result;
+ result=false;
+ if (Keys[code]==KEY_PRESS) result=true;
+ preversion[code]=Keys[code];
+ return result;
+}
+
+bool Keyboard::check_press(const unsigned char code)
+{
+ return this->check_state(code,KEY_PRESS);
+}
+
+bool Keyboard::check_release(const unsigned char code)
+{
+ return this->check_state(code,KEY_RELEASE);
+}
+
+Mouse::Mouse()
+{
+ preversion[MOUSE_LEFT]=KEY_RELEASE;
+ preversion[MOUSE_RIGHT]=KEY_RELEASE;
+ preversion[MOUSE_MIDDLE]=KEY_RELEASE;
+ position.x=0;
+ position.y=0;
+}
+
+Mouse::~Mouse()
+{
+ while(ShowCursor(TRUE)<1) ;
+}
+
+void Mouse::get_position()
+{
+ if (GetCursorPos(&position)==FALSE)
+ {
+  Halt("Can't get the mouse cursor position");
+ }
+
+}
+
+bool Mouse::check_state(const MOUSE_BUTTON button,const unsigned char state)
+{
+ bool result;
+ result=false;
+ if (Buttons[button]==state)
+ {
+  if (preversion[button]!=state) result=true;
+ }
+ preversion[button]=Buttons[button];
+ return result;
+}
+
+void Mouse::show()
+{
+ while(ShowCursor(TRUE)<1) ;
+}
+
+void Mouse::hide()
+{
+ while(ShowCursor(FALSE)>-2) ;
+}
+
+void Mouse::set_position(const unsigned long int x,const unsigned long int y)
+{
+ if (SetCursorPos(x,y)==FALSE)
+ {
+  Halt("Can't set the mouse cursor position");
+ }
+
+}
+
+unsigned long int Mouse::get_x()
+{
+ this->get_position();
+ return position.x;
+}
+
+unsigned long int Mouse::get_y()
+{
+ this->get_position();
+ return position.y;
+}
+
+bool Mouse::check_hold(const MOUSE_BUTTON button)
+{
+ bool result;
+ result=false;
+ if (Buttons[button]==KEY_PRESS)
+ {
+  result=true;
+ }
+ preversion[button]=Buttons[button];
+ return result;
+}
+
+bool Mouse::check_press(const MOUSE_BUTTON button)
+{
+ return this->check_state(button,KEY_PRESS);
+}
+
+bool Mouse::check_release(const MOUSE_BUTTON button)
+{
+ return this->check_state(button,KEY_RELEASE);
+}
+
+Gamepad::Gamepad()
+{
+ length=sizeof(XINPUT_STATE);
+ XInputEnable(TRUE);
+ memset(&current,0,length);
+ memset(&preversion,0,length);
+ memset(&vibration,0,sizeof(XINPUT_VIBRATION));
+ memset(&battery,0,sizeof(XINPUT_BATTERY_INFORMATION));
+ active=0;
+}
+
+Gamepad::~Gamepad()
+{
+ XInputEnable(FALSE);
+}
+
+bool Gamepad::read_battery_status()
+{
+ return XInputGetBatteryInformation(active,BATTERY_DEVTYPE_GAMEPAD,&battery)==ERROR_SUCCESS;
+}
+
+void Gamepad::clear_state()
+{
+ memset(&current,0,length);
+ memset(&preversion,0,length);
+}
+
+bool Gamepad::read_state()
+{
+ return XInputGetState(active,&current)==ERROR_SUCCESS;
+}
+
+bool Gamepad::write_state()
+{
+ return XInputSetState(active,&vibration)==ERROR_SUCCESS;
+}
+
+void Gamepad::set_motor(const unsigned short int left,const unsigned short int right)
+{
+ vibration.wLeftMotorSpeed=left;
+ vibration.wRightMotorSpeed=right;
+}
+
+bool Gamepad::check_button(XINPUT_STATE &target,const GAMEPAD_BUTTONS button)
+{
+ bool result;
+ result=false;
+ if (target.Gamepad.wButtons&button) result=true;
+ return result;
+}
+
+bool Gamepad::check_trigger(XINPUT_STATE &target,const GAMEPAD_TRIGGERS trigger)
+{
+ bool result;
+ result=false;
+ if (trigger==GAMEPAD_LEFT_TRIGGER)
+ {
+  if (target.Gamepad.bLeftTrigger>=XINPUT_GAMEPAD_TRIGGER_THRESHOLD) result=true;
+ }
+ else
+ {
+  if (target.Gamepad.bRightTrigger>=XINPUT_GAMEPAD_TRIGGER_THRESHOLD) result=true;
+ }
+ return result;
+}
+
+void Gamepad::set_active(const unsigned long int gamepad)
+{
+ if (active<XUSER_MAX_COUNT)
+ {
+  this->clear_state();
+  active=gamepad;
+ }
+
+}
+
+unsigned long int Gamepad::get_active() const
+{
+ return active;
+}
+
+unsigned long int Gamepad::get_maximum_amount()
+{
+ return XUSER_MAX_COUNT;
+}
+
+unsigned long int Gamepad::get_amount()
+{
+ unsigned long int old,result;
+ result=0;
+ old=active;
+ for (active=0;active<XUSER_MAX_COUNT;++active)
+ {
+  if (this->read_state()==true)
+  {
+   this->clear_state();
+   result=active+1;
+  }
+
+ }
+ active=old;
+ return result;
+}
+
+unsigned long int Gamepad::get_last_index()
+{
+ unsigned long int last_index;
+ last_index=this->get_amount();
+ if (last_index>0) --last_index;
+ return last_index;
+}
+
+bool Gamepad::check_connection()
+{
+ return this->read_state();
+}
+
+bool Gamepad::is_wireless()
+{
+ bool result;
+ result=false;
+ if (this->read_battery_status()==true)
+ {
+  if (battery.BatteryType!=BATTERY_TYPE_WIRED) result=true;
+ }
+ return result;
+}
+
+GAMEPAD_BATTERY_TYPE Gamepad::get_battery_type()
+{
+ GAMEPAD_BATTERY_TYPE result;
+ result=GAMEPAD_BATTERY_TYPE_ERROR;
+ if (this->read_battery_status()==true)
+ {
+  switch (battery.BatteryType)
+  {
+   case BATTERY_TYPE_ALKALINE:
+   result=GAMEPAD_BATTERY_ALKAINE;
+   break;
+   case BATTERY_TYPE_NIMH:
+   result=GAMEPAD_BATTERY_NIMH;
+   break;
+   case BATTERY_TYPE_UNKNOWN:
+   result=GAMEPAD_BATTERY_UNKNOW;
+   break;
+  }
+
+ }
+ return result;
+}
+
+GAMEPAD_BATTERY_LEVEL Gamepad::get_battery_level()
+{
+ GAMEPAD_BATTERY_LEVEL result;
+ result=GAMEPAD_BATTERY_LEVEL_ERROR;
+ if (this->read_battery_status()==true)
+ {
+  switch (battery.BatteryLevel)
+  {
+   case BATTERY_LEVEL_EMPTY:
+   result=GAMEPAD_BATTERY_EMPTY;
+   break;
+   case BATTERY_LEVEL_LOW:
+   result=GAMEPAD_BATTERY_LOW;
+   break;
+   case BATTERY_LEVEL_MEDIUM:
+   result=GAMEPAD_BATTERY_MEDIUM;
+   break;
+   case BATTERY_LEVEL_FULL:
+   result=GAMEPAD_BATTERY_FULL;
+   break;
+  }
+  if ((battery.BatteryType==BATTERY_TYPE_WIRED)||(battery.BatteryType==BATTERY_TYPE_DISCONNECTED)) result=GAMEPAD_BATTERY_LEVEL_ERROR;
+ }
+ return result;
+}
+
+void Gamepad::update()
+{
+ preversion=current;
+ if (this->read_state()==false) this->clear_state();
+}
+
+bool Gamepad::check_button_hold(const GAMEPAD_BUTTONS button)
+{
+ return this->check_button(current,button);
+}
+
+bool Gamepad::check_button_press(const GAMEPAD_BUTTONS button)
+{
+ bool result;
+ result=false;
+ if (this->check_button(current,button)==true)
+ {
+  if (this->check_button(preversion,button)==false) result=true;
+ }
+ return result;
+}
+
+bool Gamepad::check_button_release(const GAMEPAD_BUTTONS button)
+{
+ bool result;
+ result=false;
+ if (this->check_button(current,button)==false)
+ {
+  if (this->check_button(preversion,button)==true) result=true;
+ }
+ return result;
+}
+
+bool Gamepad::check_trigger_hold(const GAMEPAD_TRIGGERS trigger)
+{
+ return this->check_trigger(current,trigger);
+}
+
+bool Gamepad::check_trigger_press(const GAMEPAD_TRIGGERS trigger)
+{
+ bool result;
+ result=false;
+ if (this->check_trigger(current,trigger)==true)
+ {
+  if (this->check_trigger(preversion,trigger)==false) result=true;
+ }
+ return result;
+}
+
+bool Gamepad::check_trigger_release(const GAMEPAD_TRIGGERS trigger)
+{
+ bool result;
+ result=false;
+ if (this->check_trigger(current,trigger)==false)
+ {
+  if (this->check_trigger(preversion,trigger)==true) result=true;
+ }
+ return result;
+}
+
+unsigned char Gamepad::get_trigger(const GAMEPAD_TRIGGERS trigger) const
+{
+ unsigned char result;
+ result=0;
+ if (trigger==GAMEPAD_LEFT_TRIGGER) result=current.Gamepad.bLeftTrigger;
+ if (trigger==GAMEPAD_RIGHT_TRIGGER) result=current.Gamepad.bRightTrigger;
+ return result;
+}
+
+unsigned char Gamepad::get_left_trigger() const
+{
+ return current.Gamepad.bLeftTrigger;
+}
+
+unsigned char Gamepad::get_right_trigger() const
+{
+ return current.Gamepad.bRightTrigger;
+}
+
+bool Gamepad::set_vibration(const unsigned short int left,const unsigned short int right)
+{
+ this->set_motor(left,right);
+ return this->write_state();
+}
+
+bool Gamepad::disable_vibration()
+{
+ return this->set_vibration(0,0);
+}
+
+GAMEPAD_DIRECTION Gamepad::get_stick_x(const GAMEPAD_STICKS stick) const
+{
+ GAMEPAD_DIRECTION result;
+ short int control;
+ result=GAMEPAD_NEUTRAL_DIRECTION;
+ if (stick==GAMEPAD_LEFT_STICK)
+ {
+  control=SHRT_MAX-XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE;
+  if (current.Gamepad.sThumbLX>=control) result=GAMEPAD_POSITIVE_DIRECTION;
+  if (current.Gamepad.sThumbLX<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+ }
+ if (stick==GAMEPAD_RIGHT_STICK)
+ {
+  control=SHRT_MAX-XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE;
+  if (current.Gamepad.sThumbRX>=control) result=GAMEPAD_POSITIVE_DIRECTION;
+  if (current.Gamepad.sThumbRX<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+ }
+ return result;
+}
+
+GAMEPAD_DIRECTION Gamepad::get_stick_y(const GAMEPAD_STICKS stick) const
+{
+ GAMEPAD_DIRECTION result;
+ short int control;
+ result=GAMEPAD_NEUTRAL_DIRECTION;
+ if (stick==GAMEPAD_LEFT_STICK)
+ {
+  control=SHRT_MAX-XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE;
+  if (current.Gamepad.sThumbLY>=control) result=GAMEPAD_POSITIVE_DIRECTION;
+  if (current.Gamepad.sThumbLY<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+ }
+ if (stick==GAMEPAD_RIGHT_STICK)
+ {
+  control=SHRT_MAX-XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE;
+  if (current.Gamepad.sThumbRY>=control) result=GAMEPAD_POSITIVE_DIRECTION;
+  if (current.Gamepad.sThumbRY<=-1*control) result=GAMEPAD_NEGATIVE_DIRECTION;
+ }
+ return result;
+}
+
+Multimedia::Multimedia()
+{
+ loader=NULL;
+ player=NULL;
+ controler=NULL;
+ video=NULL;
+}
+
+Multimedia::~Multimedia()
+{
+ if (player!=NULL) player->StopWhenReady();
+ if (video!=NULL) video->Release();
+ if (controler!=NULL) controler->Release();
+ if (player!=NULL) player->Release();
+ if (loader!=NULL) loader->Release();
+}
+
+void Multimedia::open(const wchar_t *target)
+{
+ player->StopWhenReady();
+ if (loader->RenderFile(target,NULL)!=S_OK)
+ {
+  Halt("Can't load a multimedia file");
+ }
+ video->put_FullScreenMode(OATRUE);
+}
+
+bool Multimedia::is_play()
+{
+ bool result;
+ long long current,total;
+ result=false;
+ if (controler->GetPositions(&current,&total)==S_OK)
+ {
+  if (current<total) result=true;
+ }
+ return result;
+}
+
+void Multimedia::rewind()
+{
+ long long position;
+ position=0;
+ if (controler->SetPositions(&position,AM_SEEKING_AbsolutePositioning,NULL,AM_SEEKING_NoPositioning)!=S_OK)
+ {
+  Halt("Can't set start position");
+ }
+
+}
+
+void Multimedia::create_loader()
+{
+ if (CoCreateInstance(CLSID_FilterGraph,NULL,CLSCTX_INPROC_SERVER,IID_IGraphBuilder,reinterpret_cast<void**>(&loader))!=S_OK)
+ {
+  Halt("Can't create a multimedia loader");
+ }
+
+}
+
+void Multimedia::create_player()
+{
+ if (loader->QueryInterface(IID_IMediaControl,reinterpret_cast<void**>(&player))!=S_OK)
+ {
+  Halt("Can't create a multimedia player");
+ }
+
+}
+
+void Multimedia::create_controler()
+{
+ if (loader->QueryInterface(IID_IMediaSeeking,reinterpret_cast<void**>(&controler))!=S_OK)
+ {
+  Halt("Can't create a player controler");
+ }
+
+}
+
+void Multimedia::create_video_player()
+{
+ if (loader->QueryInterface(IID_IVideoWindow,reinterpret_cast<void**>(&video))!=S_OK)
+ {
+  Halt("Can't create a video player");
+ }
+
+}
+
+void Multimedia::initialize()
+{
+ this->create_loader();
+ this->create_player();
+ this->create_controler();
+ this->create_video_player();
+}
+
+void Multimedia::load(const char *target)
+{
+ Unicode_Convertor convertor;
+ this->open(convertor.convert(target));
+}
+
+bool Multimedia::check_playing()
+{
+ OAFilterState state;
+ bool result;
+ result=false;
+ if (player->GetState(INFINITE,&state)!=E_FAIL)
+ {
+  if (state==State_Running) result=this->is_play();
+ }
+ return result;
+}
+
+void Multimedia::stop()
+{
+ player->StopWhenReady();
+}
+
+void Multimedia::play()
+{
+ this->stop();
+ this->rewind();
+ player->Run();
+}
+
+Memory::Memory()
+{
+ memset(&memory,0,sizeof(MEMORYSTATUSEX));
+ memory.dwLength=sizeof(MEMORYSTATUSEX);
+}
+
+Memory::~Memory()
+{
+
+}
+
+void Memory::get_status()
+{
+ if (GlobalMemoryStatusEx(&memory)==FALSE)
+ {
+  Halt("Can't get the memory status");
+ }
+
+}
+
+unsigned long long int Memory::get_total_physical()
+{
+ this->get_status();
+ return memory.ullTotalPhys;
+}
+
+unsigned long long int Memory::get_free_physical()
+{
+ this->get_status();
+ return memory.ullAvailPhys;
+}
+
+unsigned long long int Memory::get_total_virtual()
+{
+ this->get_status();
+ return memory.ullTotalVirtual;
+}
+
+unsigned long long int Memory::get_free_virtual()
+{
+ this->get_status();
+ return memory.ullAvailVirtual;
+}
+
+unsigned long int Memory::get_usage()
+{
+ this->get_status();
+ return memory.dwMemoryLoad;
+}
+
+System::System()
+{
+ srand(UINT_MAX);
+}
+
+System::~System()
+{
+
+}
+
+unsigned long int System::get_random(const unsigned long int number)
+{
+ return rand()%number;
+}
+
+void System::quit()
+{
+ exit(EXIT_SUCCESS);
+}
+
+void System::run(const char *command)
+{
+ system(command);
+}
+
+char* System::read_environment(const char *variable)
+{
+ return getenv(variable);
+}
+
+void System::enable_logging(const char *name)
+{
+ if (freopen(name,"wt",stdout)==NULL)
+ {
+  Halt("Can't create log file");
+ }
+
+}
+
+Filesystem::Filesystem()
+{
+ status=false;
+}
+
+Filesystem::~Filesystem()
+{
+
+}
+
+void Filesystem::file_exist(const char *name)
+{
+ FILE *target;
+ status=false;
+ target=fopen(name,"rb");
+ if (target!=NULL)
+ {
+  status=true;
+  fclose(target);
+ }
+
+}
+
+void Filesystem::delete_file(const char *name)
+{
+ status=(remove(name)==0);
+}
+
+bool Filesystem::get_status() const
+{
+ return status;
+}
+
+Binary_File::Binary_File()
+{
+ target=NULL;
+}
+
+Binary_File::~Binary_File()
+{
+ if (target!=NULL)
+ {
+  fclose(target);
+  target=NULL;
+ }
+
+}
+
+void Binary_File::open_file(const char *name,const char *mode)
+{
+ target=fopen(name,mode);
+ if (target==NULL)
+ {
+  Halt("Can't open the binary file");
+ }
+
+}
+
+void Binary_File::close()
+{
+ if (target!=NULL)
+ {
+  fclose(target);
+  target=NULL;
+ }
+
+}
+
+void Binary_File::set_position(const long int offset)
+{
+ fseek(target,offset,SEEK_SET);
+}
+
+long int Binary_File::get_position()
+{
+ return ftell(target);
+}
+
+long int Binary_File::get_length()
+{
+ long int result;
+ fseek(target,0,SEEK_END);
+ result=ftell(target);
+ rewind(target);
+ return result;
+}
+
+bool Binary_File::check_error()
+{
+ return ferror(target)!=0;
+}
+
+Input_File::Input_File()
+{
+
+}
+
+Input_File::~Input_File()
+{
+
+}
+
+void Input_File::open(const char *name)
+{
+ this->close();
+ this->open_file(name,"rb");
+}
+
+bool Input_File::try_open(const char *name)
+{
+ this->close();
+ target=fopen(name,"rb");
+ return target!=NULL;
+}
+
+void Input_File::read(void *buffer,const size_t length)
+{
+ fread(buffer,sizeof(char),length,target);
+}
+
+Output_File::Output_File()
+{
+
+}
+
+Output_File::~Output_File()
+{
+
+}
+
+void Output_File::open(const char *name)
+{
+ this->close();
+ this->open_file(name,"wb");
+}
+
+void Output_File::create_temp()
+{
+ this->close();
+ target=tmpfile();
+ if (target==NULL)
+ {
+  Halt("Can't create a temporary file");
+ }
+
+}
+
+void Output_File::write(void *buffer,const size_t length)
+{
+ fwrite(buffer,sizeof(char),length,target);
+}
+
+void Output_File::flush()
+{
+ fflush(target);
+}
+
+Input_Buffer::Input_Buffer()
+{
+ source=NULL;
+ buffer=NULL;
+ amount=0;
+ position=0;
+ remain=0;
+}
+
+Input_Buffer::~Input_Buffer()
+{
+ if (buffer!=NULL)
+ {
+  delete[] buffer;
+  buffer=NULL;
+ }
+
+}
+
+void Input_Buffer::create_buffer()
+{
+ if (buffer==NULL)
+ {
+  try
+  {
+   buffer=new unsigned char[65536];
+  }
+  catch (...)
+  {
+   Halt("Can't allocate memory for input buffer");
+  }
+
+ }
+
+}
+
+void Input_Buffer::fill()
+{
+ amount=65536;
+ if (amount>remain) amount=remain;
+ if (amount==0)
+ {
+  Halt("Unexpected end of file");
+ }
+ source->read(buffer,amount);
+ remain-=amount;
+ position=0;
+}
+
+void Input_Buffer::open(Input_File *target,const size_t length)
+{
+ this->create_buffer();
+ source=target;
+ remain=length;
+ amount=0;
+ position=0;
+}
+
+void Input_Buffer::read(void *target,const size_t length)
+{
+ unsigned char *output;
+ size_t done,part;
+ output=static_cast<unsigned char*>(target);
+ done=0;
+ while (done<length)
+ {
+  if (position==amount)
+  {
+   if ((length-done>=65536)&&(length-done<=remain))
+   {
+    source->read(output+done,length-done);
+    remain-=length-done;
+    done=length;
+   }
+   else
+   {
+    this->fill();
+   }
+
+  }
+  part=amount-position;
+  if (part>length-done) part=length-done;
+  memcpy(output+done,buffer+position,part);
+  position+=part;
+  done+=part;
+ }
+
+}
+
+void Input_Buffer::skip(const size_t length)
+{
+ size_t done,part;
+ done=0;
+ while (done<length)
+ {
+  if (position==amount) this->fill();
+  part=amount-position;
+  if (part>length-done) part=length-done;
+  position+=part;
+  done+=part;
+ }
+
+}
+
+unsigned char Input_Buffer::read_byte()
+{
+ if (position==amount) this->fill();
+ ++position;
+ return buffer[position-1];
+}
+
+size_t Input_Buffer::get_left() const
+{
+ return amount-position+remain;
+}
+
+Mapped_File::Mapped_File()
+{
+ target=INVALID_HANDLE_VALUE;
+ mapping=NULL;
+ view=NULL;
+ length=0;
+}
+
+Mapped_File::~Mapped_File()
+{
+ this->close();
+}
+
+void Mapped_File::open(const char *name)
+{
+ LARGE_INTEGER size;
+ this->close();
+ target=CreateFileA(name,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+ if (target==INVALID_HANDLE_VALUE)
+ {
+  Halt("Can't open the binary file");
+ }
+ if (GetFileSizeEx(target,&size)==FALSE)
+ {
+  Halt("Can't get the file size");
+ }
+ if ((size.QuadPart<=0)||(static_cast<unsigned long long int>(size.QuadPart)>static_cast<unsigned long long int>(static_cast<size_t>(-1))))
+ {
+  Halt("Can't map the file");
+ }
+ length=static_cast<size_t>(size.QuadPart);
+ mapping=CreateFileMappingA(target,NULL,PAGE_WRITECOPY,0,0,NULL);
+ if (mapping==NULL)
+ {
+  Halt("Can't map the file");
+ }
+ view=static_cast<unsigned char*>(MapViewOfFile(mapping,FILE_MAP_COPY,0,0,0));
+ if (view==NULL)
+ {
+  Halt("Can't map the file");
+ }
+
+}
+
+void Mapped_File::close()
+{
+ if (view!=NULL)
+ {
+  UnmapViewOfFile(view);
+  view=NULL;
+ }
+ if (mapping!=NULL)
+ {
+  CloseHandle(mapping);
+  mapping=NULL;
+ }
+ if (target!=INVALID_HANDLE_VALUE)
+ {
+  CloseHandle(target);
+  target=INVALID_HANDLE_VALUE;
+ }
+ length=0;
+}
+
+unsigned char *Mapped_File::get_data()
+{
+ return view;
+}
+
+size_t Mapped_File::get_length() const
+{
+ return length;
+}
+
+bool Mapped_File::check_open() const
+{
+ return view!=NULL;
+}
+
+Capture::Capture()
+{
+ thread=NULL;
+ ready=NULL;
+ filled=0;
+ written=0;
+ source=NULL;
+ format=CAPTURE_TGA;
+ slots=NULL;
+ numbers=NULL;
+ line=NULL;
+ name=NULL;
+ path=NULL;
+ capacity=0;
+ head=0;
+ tail=0;
+ length=0;
+ width=0;
+ height=0;
+ rate=60;
+ captured=0;
+ dropped=0;
+ amount=8;
+}
+
+Capture::~Capture()
+{
+ this->stop();
+}
+
+unsigned char *Capture::create_line(const size_t size)
+{
+ unsigned char *target;
+ target=NULL;
+ try
+ {
+  target=new unsigned char[size];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for capture buffer");
+ }
+ return target;
+}
+
+char *Capture::create_name(const size_t size)
+{
+ char *target;
+ target=NULL;
+ try
+ {
+  target=new char[size+1];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for capture file name");
+ }
+ return target;
+}
+
+unsigned int *Capture::create_slot()
+{
+ unsigned int *target;
+ target=NULL;
+ try
+ {
+  target=new unsigned int[length];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for capture slot");
+ }
+ return target;
+}
+
+void Capture::create_slots()
+{
+ size_t index;
+ try
+ {
+  slots=new unsigned int*[capacity];
+  numbers=new unsigned long int[capacity];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for capture slots");
+ }
+ for (index=0;index<capacity;++index)
+ {
+  slots[index]=this->create_slot();
+  numbers[index]=0;
+ }
+
+}
+
+void Capture::destroy_slots()
+{
+ size_t index;
+ if (slots!=NULL)
+ {
+  for (index=0;index<capacity;++index)
+  {
+   delete[] slots[index];
+  }
+  delete[] slots;
+  slots=NULL;
+ }
+ if (numbers!=NULL)
+ {
+  delete[] numbers;
+  numbers=NULL;
+ }
+ if (line!=NULL)
+ {
+  delete[] line;
+  line=NULL;
+ }
+ if (name!=NULL)
+ {
+  delete[] name;
+  name=NULL;
+ }
+ if (path!=NULL)
+ {
+  delete[] path;
+  path=NULL;
+ }
+
+}
+
+void Capture::copy_frame(unsigned int *target)
+{
+ unsigned long int y;
+ const unsigned int *frame;
+ frame=source->read_buffer();
+ for (y=0;y<height;++y)
+ {
+  memcpy(target,frame,static_cast<size_t>(width)*sizeof(unsigned int));
+  target+=width;
+  frame+=source->get_frame_stride();
+ }
+
+}
+
+void Capture::write_header()
+{
+ char text[128];
+ if (format==CAPTURE_Y4M)
+ {
+  sprintf(text,"YUV4MPEG2 W%lu H%lu F%lu:1 Ip A1:1 C444\n",width,height,rate);
+  stream.write(text,strlen(text));
+ }
+
+}
+
+void Capture::write_tga(const unsigned int *frame,const unsigned long int number)
+{
+ Output_File target;
+ unsigned char head[18];
+ unsigned long int x,y;
+ size_t index;
+ memset(head,0,sizeof(head));
+ head[2]=2;
+ head[12]=static_cast<unsigned char>(width&255);
+ head[13]=static_cast<unsigned char>((width>>8)&255);
+ head[14]=static_cast<unsigned char>(height&255);
+ head[15]=static_cast<unsigned char>((height>>8)&255);
+ head[16]=24;
+ head[17]=32;
+ sprintf(path,"%s%06lu.tga",name,number);
+ target.open(path);
+ target.write(head,sizeof(head));
+ for (y=0;y<height;++y)
+ {
+  index=0;
+  for (x=0;x<width;++x)
+  {
+   line[index]=static_cast<unsigned char>(frame[x]&255);
+   line[index+1]=static_cast<unsigned char>((frame[x]>>8)&255);
+   line[index+2]=static_cast<unsigned char>((frame[x]>>16)&255);
+   index+=3;
+  }
+  target.write(line,index);
+  frame+=width;
+ }
+ target.close();
+}
+
+void Capture::write_plane(const unsigned int *frame,const unsigned long int plane)
+{
+ unsigned long int x,y;
+ long int red,green,blue,value;
+ for (y=0;y<height;++y)
+ {
+  for (x=0;x<width;++x)
+  {
+   blue=static_cast<long int>(frame[x]&255);
+   green=static_cast<long int>((frame[x]>>8)&255);
+   red=static_cast<long int>((frame[x]>>16)&255);
+   value=((66*red+129*green+25*blue+128)>>8)+16;
+   if (plane==1) value=((-38*red-74*green+112*blue+128)>>8)+128;
+   if (plane==2) value=((112*red-94*green-18*blue+128)>>8)+128;
+   line[x]=static_cast<unsigned char>(value);
+  }
+  stream.write(line,width);
+  frame+=width;
+ }
+
+}
+
+void Capture::write_y4m(const unsigned int *frame)
+{
+ unsigned long int plane;
+ char text[8]="FRAME\n";
+ stream.write(text,strlen(text));
+ for (plane=0;plane<3;++plane)
+ {
+  this->write_plane(frame,plane);
+ }
+
+}
+
+void Capture::write_rgb(const unsigned int *frame)
+{
+ unsigned long int x,y;
+ size_t index;
+ for (y=0;y<height;++y)
+ {
+  index=0;
+  for (x=0;x<width;++x)
+  {
+   line[index]=static_cast<unsigned char>((frame[x]>>16)&255);
+   line[index+1]=static_cast<unsigned char>((frame[x]>>8)&255);
+   line[index+2]=static_cast<unsigned char>(frame[x]&255);
+   index+=3;
+  }
+  stream.write(line,index);
+  frame+=width;
+ }
+
+}
+
+void Capture::write_slot()
+{
+ if (format==CAPTURE_TGA) this->write_tga(slots[head],numbers[head]);
+ if (format==CAPTURE_Y4M) this->write_y4m(slots[head]);
+ if (format==CAPTURE_RGB) this->write_rgb(slots[head]);
+ head=(head+1)%capacity;
+ InterlockedIncrement(&written);
+ InterlockedDecrement(&filled);
+}
+
+DWORD WINAPI Capture::write_frames(LPVOID target)
+{
+ Capture *capture;
+ capture=static_cast<Capture*>(target);
+ while (true)
+ {
+  WaitForSingleObject(capture->ready,INFINITE);
+  if (InterlockedCompareExchange(&capture->filled,0,0)==0) break;
+  capture->write_slot();
+ }
+ return 0;
+}
+
+void Capture::set_slots(const size_t slot_amount)
+{
+ if (slot_amount>0) amount=slot_amount;
+}
+
+void Capture::set_rate(const unsigned long int fps)
+{
+ if (fps>0) rate=fps;
+}
+
+void Capture::start(Frame *target,const char *file,const CAPTURE_FORMAT kind)
+{
+ this->stop();
+ source=target;
+ format=kind;
+ width=source->get_frame_width();
+ height=source->get_frame_height();
+ length=source->get_pixels();
+ capacity=amount;
+ head=0;
+ tail=0;
+ filled=0;
+ written=0;
+ captured=0;
+ dropped=0;
+ name=this->create_name(strlen(file));
+ strcpy(name,file);
+ path=this->create_name(strlen(file)+16);
+ line=this->create_line(static_cast<size_t>(width)*3);
+ this->create_slots();
+ if (format!=CAPTURE_TGA)
+ {
+  stream.open(name);
+  this->write_header();
+ }
+ ready=CreateSemaphore(NULL,0,static_cast<LONG>(capacity)+1,NULL);
+ if (ready==NULL)
+ {
+  Halt("Can't create synchronization objects for capture thread");
+ }
+ thread=CreateThread(NULL,0,Capture::write_frames,this,0,NULL);
+ if (thread==NULL)
+ {
+  Halt("Can't create capture thread");
+ }
+
+}
+
+void Capture::stop()
+{
+ if (thread!=NULL)
+ {
+  ReleaseSemaphore(ready,1,NULL);
+  WaitForSingleObject(thread,INFINITE);
+  CloseHandle(thread);
+  CloseHandle(ready);
+  thread=NULL;
+  ready=NULL;
+  stream.close();
+  this->destroy_slots();
+  source=NULL;
+ }
+
+}
+
+bool Capture::capture()
+{
+ bool result;
+ result=false;
+ if (thread!=NULL)
+ {
+  if (InterlockedCompareExchange(&filled,0,0)<static_cast<LONG>(capacity))
+  {
+   this->copy_frame(slots[tail]);
+   numbers[tail]=captured;
+   tail=(tail+1)%capacity;
+   InterlockedIncrement(&filled);
+   ReleaseSemaphore(ready,1,NULL);
+   result=true;
+  }
+  else
+  {
+   ++dropped;
+  }
+  ++captured;
+ }
+ return result;
+}
+
+bool Capture::check_capture() const
+{
+ return thread!=NULL;
+}
+
+unsigned long int Capture::get_captured() const
+{
+ return captured;
+}
+
+unsigned long int Capture::get_dropped() const
+{
+ return dropped;
+}
+
+unsigned long int Capture::get_written() const
+{
+ return static_cast<unsigned long int>(written);
+}
+
+Capture* Capture::get_handle()
+{
+ return this;
+}
+
+Primitive::Primitive()
+{
+ color.red=0;
+ color.green=0;
+ color.blue=0;
+ surface=NULL;
+}
+
+Primitive::~Primitive()
+{
+
+}
+
+void Primitive::initialize(Frame *screen)
+{
+ surface=screen;
+}
+
+unsigned int Primitive::get_pixel() const
+{
+ return static_cast<unsigned int>(color.blue)+(static_cast<unsigned int>(color.green)<<8)+(static_cast<unsigned int>(color.red)<<16);
+}
+
+void Primitive::plot(unsigned int *target,const unsigned long int x,const unsigned long int y,const unsigned int pixel)
+{
+ if ((x<surface->get_frame_width())&&(y<surface->get_frame_height()))
+ {
+  target[static_cast<size_t>(x)+static_cast<size_t>(y)*static_cast<size_t>(surface->get_frame_stride())]=pixel;
+ }
+
+}
+
+void Primitive::set_color(const unsigned char red,const unsigned char green,const unsigned char blue)
+{
+ color.red=red;
+ color.green=green;
+ color.blue=blue;
+}
+
+void Primitive::draw_line(const unsigned long int x1,const unsigned long int y1,const unsigned long int x2,const unsigned long int y2)
+{
+ unsigned long int delta_x,delta_y,index,steps;
+ unsigned int pixel;
+ unsigned int *target;
+ float x,y,shift_x,shift_y;
+ if (x1>x2)
+ {
+  delta_x=x1-x2;
+ }
+ else
+ {
+  delta_x=x2-x1;
+ }
+ if (y1>y2)
+ {
+  delta_y=y1-y2;
+ }
+ else
+ {
+  delta_y=y2-y1;
+ }
+ steps=delta_x;
+ if (steps<delta_y) steps=delta_y;
+ x=x1;
+ y=y1;
+ shift_x=static_cast<float>(delta_x)/static_cast<float>(steps);
+ shift_y=static_cast<float>(delta_y)/static_cast<float>(steps);
+ pixel=this->get_pixel();
+ target=surface->get_buffer(x1,y1,delta_x+1,delta_y+1);
+ for (index=steps;index>0;--index)
+ {
+  x+=shift_x;
+  y+=shift_y;
+  this->plot(target,static_cast<unsigned long int>(x),static_cast<unsigned long int>(y),pixel);
+ }
+
+}
+
+void Primitive::draw_rectangle(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+{
+ unsigned long int stop_x,stop_y;
+ stop_x=x+width;
+ stop_y=y+height;
+ this->draw_line(x,y,stop_x,y);
+ this->draw_line(x,stop_y,stop_x,stop_y);
+ this->draw_line(x,y,x,stop_y);
+ this->draw_line(stop_x,y,stop_x,stop_y);
+}
+
+void Primitive::draw_filled_rectangle(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
+{
+ unsigned long int step_x,step_y,stop_x,stop_y;
+ unsigned int pixel;
+ unsigned int *target;
+ stop_x=x+width;
+ stop_y=y+height;
+ pixel=this->get_pixel();
+ target=surface->get_buffer(x,y,width,height);
+ for (step_y=y;step_y<stop_y;++step_y)
+ {
+  for (step_x=x;step_x<stop_x;++step_x)
+  {
+   this->plot(target,step_x,step_y,pixel);
+  }
+
+ }
+
+}
+
+Image::Image()
+{
+ width=0;
+ height=0;
+ depth=24;
+ data=NULL;
+}
+
+Image::~Image()
+{
+ this->clear_buffer();
+}
+
+unsigned char *Image::create_buffer(const size_t length)
+{
+ unsigned char *result;
+ result=NULL;
+ try
+ {
+  result=new unsigned char[length];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for image buffer");
+ }
+ return result;
+}
+
+void Image::clear_buffer()
+{
+ if (mapping.check_open())
+ {
+  mapping.close();
+  data=NULL;
+ }
+ if (data!=NULL)
+ {
+  delete[] data;
+  data=NULL;
+ }
+
+}
+
+void Image::decode_tga(Input_Buffer &source,unsigned char *target,const size_t length)
+{
+ size_t index,amount,pixel;
+ unsigned char packet;
+ index=0;
+ pixel=depth/8;
+ while (index<length)
+ {
+  packet=source.read_byte();
+  amount=(static_cast<size_t>(packet&127)+1)*pixel;
+  if (amount>length-index)
+  {
+   Halt("Invalid image format");
+  }
+  if (packet<128)
+  {
+   source.read(target+index,amount);
+  }
+  else
+  {
+   source.read(target+index,pixel);
+   fill_pattern(target+index,pixel,amount);
+  }
+  index+=amount;
+ }
+
+}
+
+void Image::flip_image(unsigned char *target)
+{
+ unsigned long int y;
+ size_t row;
+ unsigned char *line;
+ row=static_cast<size_t>(width)*static_cast<size_t>(depth/8);
+ line=this->create_buffer(row);
+ for (y=0;y<height/2;++y)
+ {
+  memcpy(line,target+static_cast<size_t>(y)*row,row);
+  memcpy(target+static_cast<size_t>(y)*row,target+static_cast<size_t>(height-y-1)*row,row);
+  memcpy(target+static_cast<size_t>(height-y-1)*row,line,row);
+ }
+ delete[] line;
+}
+
+bool Image::check_tga(const char *name)
+{
+ Input_File target;
+ Input_Buffer stream;
+ size_t file_length,length,index,amount,pixel,used;
+ unsigned char packet;
+ bool result;
+ TGA_head head;
+ TGA_map color_map;
+ TGA_image image;
+ file_length=0;
+ result=target.try_open(name);
+ if (result==true)
+ {
+  file_length=static_cast<size_t>(target.get_length());
+  result=file_length>=18;
+ }
+ if (result==true)
+ {
+  target.read(&head,3);
+  target.read(&color_map,5);
+  target.read(&image,10);
+  result=(head.color_map==0)&&((image.color==24)||(image.color==32))&&((head.type==2)||(head.type==10));
+  if ((image.width==0)||(image.height==0)||(file_length<18+static_cast<size_t>(head.id))) result=false;
+ }
+ if (result==true)
+ {
+  pixel=image.color/8;
+  length=static_cast<size_t>(image.width)*static_cast<size_t>(image.height)*pixel;
+  if (head.type==2) result=file_length-18-static_cast<size_t>(head.id)>=length;
+  if (head.type==10)
+  {
+   target.set_position(18+head.id);
+   stream.open(&target,file_length-18-static_cast<size_t>(head.id));
+   index=0;
+   while ((result==true)&&(index<length))
+   {
+    result=stream.get_left()>0;
+    if (result==true)
+    {
+     packet=stream.read_byte();
+     amount=(static_cast<size_t>(packet&127)+1)*pixel;
+     used=pixel;
+     if (packet<128) used=amount;
+     result=(amount<=length-index)&&(used<=stream.get_left());
+    }
+    if (result==true)
+    {
+     stream.skip(used);
+     index+=amount;
+    }
+
+   }
+
+  }
+
+ }
+ return result;
+}
+
+void Image::load_tga(const char *name)
+{
+ Input_File target;
+ Input_Buffer stream;
+ size_t file_length,uncompressed_length;
+ unsigned char *uncompressed;
+ TGA_head head;
+ TGA_map color_map;
+ TGA_image image;
+ this->clear_buffer();
+ target.open(name);
+ file_length=static_cast<size_t>(target.get_length());
+ if (file_length<18)
+ {
+  Halt("Invalid image format");
+ }
+ target.read(&head,3);
+ target.read(&color_map,5);
+ target.read(&image,10);
+ if ((head.color_map!=0)||((image.color!=24)&&(image.color!=32)))
+ {
+  Halt("Invalid image format");
+ }
+ if (head.type!=2)
+ {
+  if (head.type!=10)
+  {
+   Halt("Invalid image format");
+  }
+
+ }
+ if ((image.width==0)||(image.height==0)||(file_length<18+static_cast<size_t>(head.id)))
+ {
+  Halt("Invalid image format");
+ }
+ width=image.width;
+ height=image.height;
+ depth=image.color;
+ uncompressed_length=this->get_length();
+ if (head.type==2)
+ {
+  target.close();
+  mapping.open(name);
+  if (mapping.get_length()-18-static_cast<size_t>(head.id)<uncompressed_length)
+  {
+   Halt("Invalid image format");
+  }
+  data=mapping.get_data()+18+static_cast<size_t>(head.id);
+ }
+ if (head.type==10)
+ {
+  target.set_position(18+head.id);
+  uncompressed=this->create_buffer(uncompressed_length);
+  stream.open(&target,file_length-18-static_cast<size_t>(head.id));
+  this->decode_tga(stream,uncompressed,uncompressed_length);
+  target.close();
+  data=uncompressed;
+ }
+ if ((image.direction&4)==0) this->flip_image(data);
+}
+
+void Image::decode_pcx(Input_Buffer &source,unsigned char *target,const size_t length,size_t &repeat,unsigned char &value)
+{
+ size_t index,amount;
+ index=0;
+ while (index<length)
+ {
+  if (repeat==0)
+  {
+   value=source.read_byte();
+   repeat=1;
+   if (value>=192)
+   {
+    repeat=value-192;
+    value=source.read_byte();
+   }
+
+  }
+  amount=repeat;
+  if (amount>length-index) amount=length-index;
+  memset(target+index,value,amount);
+  index+=amount;
+  repeat-=amount;
+ }
+
+}
+
+bool Image::check_pcx(const char *name)
+{
+ Input_File target;
+ Input_Buffer stream;
+ size_t file_length,data_length,length,index;
+ unsigned char value;
+ unsigned char marker;
+ bool result;
+ PCX_head head;
+ file_length=0;
+ data_length=0;
+ result=target.try_open(name);
+ if (result==true)
+ {
+  file_length=static_cast<size_t>(target.get_length());
+  result=file_length>=128;
+ }
+ if (result==true)
+ {
+  target.read(&head,128);
+  result=(head.compress==1)&&(head.color==8)&&((head.planes==1)||(head.planes==3))&&(head.max_x>=head.min_x)&&(head.max_y>=head.min_y);
+ }
+ if (result==true)
+ {
+  result=head.plane_length>=head.max_x-head.min_x+1;
+  data_length=file_length-128;
+ }
+ if ((result==true)&&(head.planes==1))
+ {
+  result=data_length>=769;
+  if (result==true)
+  {
+   data_length-=769;
+   target.set_position(static_cast<long int>(file_length-769));
+   target.read(&marker,1);
+   result=marker==12;
+   target.set_position(128);
+  }
+
+ }
+ if (result==true)
+ {
+  length=static_cast<size_t>(head.planes)*static_cast<size_t>(head.plane_length)*static_cast<size_t>(head.max_y-head.min_y+1);
+  stream.open(&target,data_length);
+  index=0;
+  while ((result==true)&&(index<length))
+  {
+   result=stream.get_left()>0;
+   if (result==true)
+   {
+    value=stream.read_byte();
+    if (value>=192)
+    {
+     result=stream.get_left()>0;
+     if (result==true) stream.read_byte();
+     index+=value-192;
+    }
+    else
+    {
+     ++index;
+    }
+
+   }
+
+  }
+
+ }
+ return result;
+}
+
+void Image::load_pcx(const char *name)
+{
+ Processor processor;
+ Input_File target;
+ Input_Buffer stream;
+ unsigned long int y;
+ size_t repeat,row,line,file_length,data_length;
+ unsigned char value;
+ unsigned char palette[769];
+ unsigned char *scanline;
+ unsigned char *uncompressed;
+ PCX_head head;
+ void (*merge_kernel)(unsigned char*,const unsigned char*,const unsigned char*,const unsigned char*,const size_t);
+ this->clear_buffer();
+ target.open(name);
+ file_length=static_cast<size_t>(target.get_length());
+ if (file_length<128)
+ {
+  Halt("Incorrect image format");
+ }
+ target.read(&head,128);
+ if ((head.compress!=1)||(head.color!=8)||((head.planes!=1)&&(head.planes!=3))||(head.max_x<head.min_x)||(head.max_y<head.min_y))
+ {
+  Halt("Incorrect image format");
+ }
+ depth=24;
+ width=head.max_x-head.min_x+1;
+ height=head.max_y-head.min_y+1;
+ if (head.plane_length<width)
+ {
+  Halt("Incorrect image format");
+ }
+ data_length=file_length-128;
+ if (head.planes==1)
+ {
+  if (data_length<769)
+  {
+   Halt("Incorrect image format");
+  }
+  data_length-=769;
+  target.set_position(static_cast<long int>(file_length-769));
+  target.read(palette,769);
+  if (palette[0]!=12)
+  {
+   Halt("Incorrect image format");
+  }
+  target.set_position(128);
+ }
+ merge_kernel=merge_planes;
+ #ifdef BLACKGDK_SSE2
+ if (processor.check_sse2()==true) merge_kernel=merge_planes_sse2;
+ #endif
+ row=static_cast<size_t>(width)*3;
+ line=static_cast<size_t>(head.planes)*static_cast<size_t>(head.plane_length);
+ scanline=this->create_buffer(line);
+ uncompressed=this->create_buffer(row*static_cast<size_t>(height));
+ stream.open(&target,data_length);
+ repeat=0;
+ value=0;
+ for (y=0;y<height;++y)
+ {
+  this->decode_pcx(stream,scanline,line,repeat,value);
+  if (head.planes==3)
+  {
+   merge_kernel(uncompressed+static_cast<size_t>(y)*row,scanline,scanline+head.plane_length,scanline+2*static_cast<size_t>(head.plane_length),width);
+  }
+  else
+  {
+   expand_palette(uncompressed+static_cast<size_t>(y)*row,scanline,palette+1,width);
+  }
+
+ }
+ target.close();
+ delete[] scanline;
+ data=uncompressed;
 }
 
-char* System::read_environment(const char *variable)
+unsigned long int Image::get_width() const
 {
- return getenv(variable);
+ return width;
 }
 
-void System::enable_logging(const char *name)
+unsigned long int Image::get_height() const
 {
- if (freopen(name,"wt",stdout)==NULL)
- {
-  Halt("Can't create log file");
- }
-
+ return height;
 }
 
-Filesystem::Filesystem()
+unsigned long int Image::get_depth() const
 {
- status=false;
+ return depth;
 }
 
-Filesystem::~Filesystem()
+size_t Image::get_length() const
 {
-
+ return static_cast<size_t>(width)*static_cast<size_t>(height)*static_cast<size_t>(depth/8);
 }
 
-void Filesystem::file_exist(const char *name)
+unsigned char *Image::get_data()
 {
- FILE *target;
- status=false;
- target=fopen(name,"rb");
- if (target!=NULL)
- {
-  status=true;
-  fclose(target);
- }
-
+ return data;
 }
 
-void Filesystem::delete_file(const char *name)
+void Image::destroy_image()
 {
- status=(remove(name)==0);
+ width=0;
+ height=0;
+ this->clear_buffer();
 }
 
-bool Filesystem::get_status() const
+Pack_File::Pack_File()
 {
- return status;
+ head=NULL;
+ entries=NULL;
+ current=NULL;
 }
 
-Binary_File::Binary_File()
+Pack_File::~Pack_File()
 {
- target=NULL;
+ this->close();
 }
 
-Binary_File::~Binary_File()
+void Pack_File::check_pack()
 {
- if (target!=NULL)
+ size_t length,index;
+ Pack_Entry *entry;
+ length=mapping.get_length();
+ if (length<sizeof(Pack_Head))
  {
-  fclose(target);
-  target=NULL;
+  Halt("Invalid pack file");
  }
-
-}
-
-void Binary_File::open_file(const char *name,const char *mode)
-{
- target=fopen(name,mode);
- if (target==NULL)
+ head=reinterpret_cast<Pack_Head*>(mapping.get_data());
+ if ((memcmp(head->signature,"BGDKPACK",8)!=0)||(head->version!=1)||(head->buckets==0)||((head->buckets&(head->buckets-1))!=0))
  {
-  Halt("Can't open the binary file");
+  Halt("Invalid pack file");
  }
-
-}
-
-void Binary_File::close()
-{
- if (target!=NULL)
+ if (static_cast<size_t>(head->buckets)>(length-sizeof(Pack_Head))/sizeof(Pack_Entry))
  {
-  fclose(target);
-  target=NULL;
+  Halt("Invalid pack file");
  }
+ entries=reinterpret_cast<Pack_Entry*>(mapping.get_data()+sizeof(Pack_Head));
+ for (index=0;index<head->buckets;++index)
+ {
+  entry=entries+index;
+  if (entry->used!=0)
+  {
+   if ((entry->name_offset>length)||(entry->name_length>length-entry->name_offset)||(entry->width==0)||(entry->height==0)||((entry->offset%4)!=0))
+   {
+    Halt("Invalid pack file");
+   }
+   if ((entry->offset>length)||(static_cast<unsigned long long int>(entry->width)*static_cast<unsigned long long int>(entry->height)*4>length-entry->offset))
+   {
+    Halt("Invalid pack file");
+   }
 
-}
-
-void Binary_File::set_position(const long int offset)
-{
- fseek(target,offset,SEEK_SET);
-}
-
-long int Binary_File::get_position()
-{
- return ftell(target);
-}
-
-long int Binary_File::get_length()
-{
- long int result;
- fseek(target,0,SEEK_END);
- result=ftell(target);
- rewind(target);
- return result;
-}
-
-bool Binary_File::check_error()
-{
- return ferror(target)!=0;
-}
-
-Input_File::Input_File()
-{
-
-}
+  }
 
-Input_File::~Input_File()
-{
+ }
 
 }
 
-void Input_File::open(const char *name)
+void Pack_File::open(const char *name)
 {
  this->close();
- this->open_file(name,"rb");
+ mapping.open(name);
+ this->check_pack();
 }
 
-void Input_File::read(void *buffer,const size_t length)
+void Pack_File::close()
 {
- fread(buffer,sizeof(char),length,target);
+ mapping.close();
+ head=NULL;
+ entries=NULL;
+ current=NULL;
 }
 
-Output_File::Output_File()
+bool Pack_File::find(const char *name)
 {
+ size_t length,index,mask,amount;
+ unsigned int hash;
+ Pack_Entry *entry;
+ current=NULL;
+ if (head!=NULL)
+ {
+  length=strlen(name);
+  hash=hash_name(name,length);
+  mask=static_cast<size_t>(head->buckets)-1;
+  index=static_cast<size_t>(hash)&mask;
+  for (amount=0;amount<head->buckets;++amount)
+  {
+   entry=entries+index;
+   if (entry->used==0) break;
+   if ((entry->hash==hash)&&(entry->name_length==length))
+   {
+    if (memcmp(mapping.get_data()+entry->name_offset,name,length)==0)
+    {
+     current=entry;
+     break;
+    }
 
-}
-
-Output_File::~Output_File()
-{
+   }
+   index=(index+1)&mask;
+  }
 
+ }
+ return current!=NULL;
 }
 
-void Output_File::open(const char *name)
+unsigned long int Pack_File::get_amount() const
 {
- this->close();
- this->open_file(name,"wb");
+ unsigned long int result;
+ result=0;
+ if (head!=NULL) result=head->amount;
+ return result;
 }
 
-void Output_File::create_temp()
+unsigned long int Pack_File::get_width() const
 {
- this->close();
- target=tmpfile();
- if (target==NULL)
- {
-  Halt("Can't create a temporary file");
- }
-
+ unsigned long int result;
+ result=0;
+ if (current!=NULL) result=current->width;
+ return result;
 }
 
-void Output_File::write(void *buffer,const size_t length)
+unsigned long int Pack_File::get_height() const
 {
- fwrite(buffer,sizeof(char),length,target);
+ unsigned long int result;
+ result=0;
+ if (current!=NULL) result=current->height;
+ return result;
 }
 
-void Output_File::flush()
+unsigned int *Pack_File::get_pixels()
 {
- fflush(target);
+ unsigned int *result;
+ result=NULL;
+ if (current!=NULL) result=reinterpret_cast<unsigned int*>(mapping.get_data()+static_cast<size_t>(current->offset));
+ return result;
 }
 
-Primitive::Primitive()
+Pack_File* Pack_File::get_handle()
 {
- color.red=0;
- color.green=0;
- color.blue=0;
- surface=NULL;
+ return this;
 }
 
-Primitive::~Primitive()
+Pack_Builder::Pack_Builder()
 {
-
+ names=NULL;
+ files=NULL;
+ formats=NULL;
+ amount=0;
+ capacity=0;
 }
 
-void Primitive::initialize(Screen *screen)
+Pack_Builder::~Pack_Builder()
 {
- surface=screen;
+ this->clear();
 }
 
-void Primitive::set_color(const unsigned char red,const unsigned char green,const unsigned char blue)
+char *Pack_Builder::create_name(const char *name)
 {
- color.red=red;
- color.green=green;
- color.blue=blue;
+ char *target;
+ target=NULL;
+ try
+ {
+  target=new char[strlen(name)+1];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for pack file name");
+ }
+ strcpy(target,name);
+ return target;
 }
 
-void Primitive::draw_line(const unsigned long int x1,const unsigned long int y1,const unsigned long int x2,const unsigned long int y2)
+void Pack_Builder::resize_list()
 {
- unsigned long int delta_x,delta_y,index,steps;
- float x,y,shift_x,shift_y;
- if (x1>x2)
+ size_t index;
+ char **new_names;
+ char **new_files;
+ IMAGE_FORMAT *new_formats;
+ new_names=NULL;
+ new_files=NULL;
+ new_formats=NULL;
+ capacity=capacity*2+16;
+ try
  {
-  delta_x=x1-x2;
+  new_names=new char*[capacity];
+  new_files=new char*[capacity];
+  new_formats=new IMAGE_FORMAT[capacity];
  }
- else
+ catch (...)
  {
-  delta_x=x2-x1;
+  Halt("Can't allocate memory for pack list");
  }
- if (y1>y2)
+ for (index=0;index<amount;++index)
  {
-  delta_y=y1-y2;
+  new_names[index]=names[index];
+  new_files[index]=files[index];
+  new_formats[index]=formats[index];
  }
- else
+ if (names!=NULL) delete[] names;
+ if (files!=NULL) delete[] files;
+ if (formats!=NULL) delete[] formats;
+ names=new_names;
+ files=new_files;
+ formats=new_formats;
+}
+
+void Pack_Builder::write_padding(Output_File &target,const size_t length)
+{
+ char padding[64];
+ memset(padding,0,sizeof(padding));
+ if ((length%64)!=0) target.write(padding,64-length%64);
+}
+
+void Pack_Builder::add_image(const char *name,const char *file,const IMAGE_FORMAT kind)
+{
+ if (amount==capacity) this->resize_list();
+ names[amount]=this->create_name(name);
+ files[amount]=this->create_name(file);
+ formats[amount]=kind;
+ ++amount;
+}
+
+void Pack_Builder::save(const char *name)
+{
+ Output_File target;
+ Image image;
+ Pack_Head head;
+ Pack_Entry *entries;
+ size_t *slots;
+ size_t *owners;
+ unsigned int *pixels;
+ size_t index,slot,mask,buckets,position,length;
+ entries=NULL;
+ slots=NULL;
+ owners=NULL;
+ pixels=NULL;
+ buckets=1;
+ while (buckets<amount*2) buckets*=2;
+ mask=buckets-1;
+ try
  {
-  delta_y=y2-y1;
+  entries=new Pack_Entry[buckets];
+  slots=new size_t[amount+1];
+  owners=new size_t[buckets];
  }
- steps=delta_x;
- if (steps<delta_y) steps=delta_y;
- x=x1;
- y=y1;
- shift_x=static_cast<float>(delta_x)/static_cast<float>(steps);
- shift_y=static_cast<float>(delta_y)/static_cast<float>(steps);
- for (index=steps;index>0;--index)
+ catch (...)
  {
-  x+=shift_x;
-  y+=shift_y;
-  surface->draw_pixel(x,y,color.red,color.green,color.blue);
+  Halt("Can't allocate memory for pack index");
  }
-
-}
-
-void Primitive::draw_rectangle(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
-{
- unsigned long int stop_x,stop_y;
- stop_x=x+width;
- stop_y=y+height;
- this->draw_line(x,y,stop_x,y);
- this->draw_line(x,stop_y,stop_x,stop_y);
- this->draw_line(x,y,x,stop_y);
- this->draw_line(stop_x,y,stop_x,stop_y);
-}
-
-void Primitive::draw_filled_rectangle(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height)
-{
- unsigned long int step_x,step_y,stop_x,stop_y;
- stop_x=x+width;
- stop_y=y+height;
- for (step_x=x;step_x<stop_x;++step_x)
+ memset(entries,0,buckets*sizeof(Pack_Entry));
+ position=sizeof(Pack_Head)+buckets*sizeof(Pack_Entry);
+ for (index=0;index<amount;++index)
  {
-  for (step_y=y;step_y<stop_y;++step_y)
+  length=strlen(names[index]);
+  slot=static_cast<size_t>(hash_name(names[index],length))&mask;
+  while (entries[slot].used!=0)
   {
-   surface->draw_pixel(step_x,step_y,color.red,color.green,color.blue);
+   if ((entries[slot].name_length==length)&&(strcmp(names[owners[slot]],names[index])==0))
+   {
+    Halt("Duplicate image name in the pack");
+   }
+   slot=(slot+1)&mask;
   }
-
+  entries[slot].hash=hash_name(names[index],length);
+  entries[slot].name_offset=static_cast<unsigned int>(position);
+  entries[slot].name_length=static_cast<unsigned int>(length);
+  entries[slot].used=1;
+  slots[index]=slot;
+  owners[slot]=index;
+  position+=length;
  }
-
-}
-
-Image::Image()
-{
- width=0;
- height=0;
- data=NULL;
-}
-
-Image::~Image()
-{
- if (data!=NULL)
+ memset(&head,0,sizeof(Pack_Head));
+ memcpy(head.signature,"BGDKPACK",8);
+ head.version=1;
+ head.amount=static_cast<unsigned int>(amount);
+ head.buckets=static_cast<unsigned int>(buckets);
+ target.open(name);
+ target.write(&head,sizeof(Pack_Head));
+ target.write(entries,buckets*sizeof(Pack_Entry));
+ for (index=0;index<amount;++index)
  {
-  delete[] data;
-  data=NULL;
+  target.write(names[index],strlen(names[index]));
  }
-
-}
-
-unsigned char *Image::create_buffer(const size_t length)
-{
- unsigned char *result;
- result=NULL;
- try
+ this->write_padding(target,position);
+ position+=(64-position%64)%64;
+ for (index=0;index<amount;++index)
  {
-  result=new unsigned char[length];
+  if (formats[index]==TGA_IMAGE) image.load_tga(files[index]);
+  if (formats[index]==PCX_IMAGE) image.load_pcx(files[index]);
+  length=static_cast<size_t>(image.get_width())*static_cast<size_t>(image.get_height());
+  try
+  {
+   pixels=new unsigned int[length];
+  }
+  catch (...)
+  {
+   Halt("Can't allocate memory for image buffer");
+  }
+  convert_image(pixels,image.get_data(),length,image.get_depth());
+  entries[slots[index]].width=image.get_width();
+  entries[slots[index]].height=image.get_height();
+  entries[slots[index]].offset=position;
+  target.write(pixels,length*sizeof(unsigned int));
+  this->write_padding(target,length*sizeof(unsigned int));
+  position+=length*sizeof(unsigned int);
+  position+=(64-position%64)%64;
+  delete[] pixels;
+  image.destroy_image();
  }
- catch (...)
+ target.set_position(sizeof(Pack_Head));
+ target.write(entries,buckets*sizeof(Pack_Entry));
+ if (target.check_error()==true)
  {
-  Halt("Can't allocate memory for image buffer");
+  Halt("Can't write the pack file");
  }
- return result;
+ target.close();
+ delete[] entries;
+ delete[] slots;
+ delete[] owners;
 }
 
-void Image::clear_buffer()
+void Pack_Builder::clear()
 {
- if (data!=NULL)
+ size_t index;
+ for (index=0;index<amount;++index)
  {
-  delete[] data;
-  data=NULL;
+  delete[] names[index];
+  delete[] files[index];
  }
+ if (names!=NULL) delete[] names;
+ if (files!=NULL) delete[] files;
+ if (formats!=NULL) delete[] formats;
+ names=NULL;
+ files=NULL;
+ formats=NULL;
+ amount=0;
+ capacity=0;
+}
 
+size_t Pack_Builder::get_amount() const
+{
+ return amount;
 }
 
-void Image::load_tga(const char *name)
+Image_Cache::Image_Cache()
+{
+ names=NULL;
+ name_hashes=NULL;
+ content_hashes=NULL;
+ storages=NULL;
+ amount=0;
+ capacity=0;
+ hits=0;
+}
+
+Image_Cache::~Image_Cache()
+{
+ this->clear();
+}
+
+void Image_Cache::resize_list()
 {
- Input_File target;
- size_t index,position,amount,compressed_length,uncompressed_length;
- unsigned char *compressed;
- unsigned char *uncompressed;
- TGA_head head;
- TGA_map color_map;
- TGA_image image;
- this->clear_buffer();
- target.open(name);
- compressed_length=static_cast<size_t>(target.get_length()-18);
- target.read(&head,3);
- target.read(&color_map,5);
- target.read(&image,10);
- if ((head.color_map!=0)||(image.color!=24))
+ size_t index;
+ char **new_names;
+ unsigned int *new_name_hashes;
+ unsigned long long int *new_content_hashes;
+ Pixel_Storage **new_storages;
+ new_names=NULL;
+ new_name_hashes=NULL;
+ new_content_hashes=NULL;
+ new_storages=NULL;
+ capacity=capacity*2+16;
+ try
  {
-  Halt("Invalid image format");
+  new_names=new char*[capacity];
+  new_name_hashes=new unsigned int[capacity];
+  new_content_hashes=new unsigned long long int[capacity];
+  new_storages=new Pixel_Storage*[capacity];
  }
- if (head.type!=2)
+ catch (...)
  {
-  if (head.type!=10)
-  {
-   Halt("Invalid image format");
-  }
-
+  Halt("Can't allocate memory for image cache");
  }
- index=0;
- position=0;
- width=image.width;
- height=image.height;
- uncompressed_length=this->get_length();
- uncompressed=this->create_buffer(uncompressed_length);
- if (head.type==2)
+ for (index=0;index<amount;++index)
  {
-  target.read(uncompressed,uncompressed_length);
+  new_names[index]=names[index];
+  new_name_hashes[index]=name_hashes[index];
+  new_content_hashes[index]=content_hashes[index];
+  new_storages[index]=storages[index];
  }
- if (head.type==10)
+ if (names!=NULL) delete[] names;
+ if (name_hashes!=NULL) delete[] name_hashes;
+ if (content_hashes!=NULL) delete[] content_hashes;
+ if (storages!=NULL) delete[] storages;
+ names=new_names;
+ name_hashes=new_name_hashes;
+ content_hashes=new_content_hashes;
+ storages=new_storages;
+}
+
+void Image_Cache::remove_entry(const size_t index)
+{
+ release_storage(storages[index]);
+ delete[] names[index];
+ --amount;
+ names[index]=names[amount];
+ name_hashes[index]=name_hashes[amount];
+ content_hashes[index]=content_hashes[amount];
+ storages[index]=storages[amount];
+}
+
+Pixel_Storage *Image_Cache::find_content(const unsigned int *pixels,const unsigned long int width,const unsigned long int height,const unsigned long long int hash)
+{
+ Pixel_Storage *result;
+ size_t index;
+ result=NULL;
+ for (index=0;index<amount;++index)
  {
-  compressed=this->create_buffer(compressed_length);
-  target.read(compressed,compressed_length);
-  while(index<uncompressed_length)
+  if ((content_hashes[index]==hash)&&(storages[index]->width==width)&&(storages[index]->height==height))
   {
-   if (compressed[position]<128)
-   {
-    amount=compressed[position]+1;
-    amount*=3;
-    memmove(uncompressed+index,compressed+(position+1),amount);
-    index+=amount;
-    position+=1+amount;
-   }
-   else
+   if (memcmp(storages[index]->pixels,pixels,static_cast<size_t>(width)*static_cast<size_t>(height)*sizeof(unsigned int))==0)
    {
-    for (amount=compressed[position]-127;amount>0;--amount)
-    {
-     memmove(uncompressed+index,compressed+(position+1),3);
-     index+=3;
-    }
-    position+=4;
+    result=storages[index];
+    break;
    }
 
   }
-  delete[] compressed;
+
  }
- target.close();
- data=uncompressed;
+ return result;
 }
 
-void Image::load_pcx(const char *name)
+Pixel_Storage *Image_Cache::get_storage(const char *name)
 {
- Input_File target;
- unsigned long int x,y;
- size_t index,position,line,row,length,uncompressed_length;
- unsigned char repeat;
- unsigned char *original;
- unsigned char *uncompressed;
- PCX_head head;
- this->clear_buffer();
- target.open(name);
- length=static_cast<size_t>(target.get_length()-128);
- target.read(&head,128);
- if ((head.color*head.planes!=24)&&(head.compress!=1))
+ Image image;
+ Pixel_Storage *result;
+ unsigned int *pixels;
+ unsigned int hash;
+ unsigned long long int content;
+ size_t index,length;
+ result=NULL;
+ hash=hash_name(name,strlen(name));
+ for (index=0;index<amount;++index)
  {
-  Halt("Incorrect image format");
+  if ((name_hashes[index]==hash)&&(strcmp(names[index],name)==0))
+  {
+   result=storages[index];
+   ++hits;
+   break;
+  }
+
  }
- width=head.max_x-head.min_x+1;
- height=head.max_y-head.min_y+1;
- row=static_cast<size_t>(width)*3;
- line=static_cast<size_t>(head.planes)*static_cast<size_t>(head.plane_length);
- uncompressed_length=row*height;
- index=0;
- position=0;
- original=this->create_buffer(length);
- uncompressed=this->create_buffer(uncompressed_length);
- target.read(original,length);
- target.close();
- while (index<length)
+ if (result==NULL)
  {
-  if (original[index]<192)
+  if (get_image_format(name)==PCX_IMAGE) image.load_pcx(name);
+  if (get_image_format(name)==TGA_IMAGE) image.load_tga(name);
+  length=static_cast<size_t>(image.get_width())*static_cast<size_t>(image.get_height());
+  pixels=static_cast<unsigned int*>(allocate_aligned(length*sizeof(unsigned int),64));
+  if (pixels==NULL)
   {
-   uncompressed[position]=original[index];
-   ++position;
-   ++index;
+   Halt("Can't allocate memory for image buffer");
+  }
+  convert_image(pixels,image.get_data(),length,image.get_depth());
+  content=hash_pixels(pixels,length);
+  result=this->find_content(pixels,image.get_width(),image.get_height(),content);
+  if (result==NULL)
+  {
+   result=create_storage(pixels,image.get_width(),image.get_height());
   }
   else
   {
-   for (repeat=original[index]-192;repeat>0;--repeat)
-   {
-    uncompressed[position]=original[index+1];
-    ++position;
-   }
-   index+=2;
+   free_aligned(pixels);
+   retain_storage(result);
+   ++hits;
   }
-
+  if (amount==capacity) this->resize_list();
+  try
+  {
+   names[amount]=new char[strlen(name)+1];
+  }
+  catch (...)
+  {
+   Halt("Can't allocate memory for image cache");
+  }
+  strcpy(names[amount],name);
+  name_hashes[amount]=hash;
+  content_hashes[amount]=content;
+  storages[amount]=result;
+  ++amount;
  }
- delete[] original;
- original=this->create_buffer(uncompressed_length);
- for (x=0;x<width;++x)
+ return result;
+}
+
+void Image_Cache::trim()
+{
+ size_t index,position;
+ LONG owners;
+ index=0;
+ while (index<amount)
  {
-  for (y=0;y<height;++y)
+  owners=0;
+  for (position=0;position<amount;++position)
+  {
+   if (storages[position]==storages[index]) ++owners;
+  }
+  if (InterlockedCompareExchange(&storages[index]->references,0,0)==owners)
+  {
+   this->remove_entry(index);
+  }
+  else
   {
-   index=static_cast<size_t>(x)*3+static_cast<size_t>(y)*row;
-   position=static_cast<size_t>(x)+static_cast<size_t>(y)*line;
-   original[index]=uncompressed[position+2*static_cast<size_t>(head.plane_length)];
-   original[index+1]=uncompressed[position+static_cast<size_t>(head.plane_length)];
-   original[index+2]=uncompressed[position];
+   ++index;
   }
 
  }
- delete[] uncompressed;
- data=original;
-}
 
-unsigned long int Image::get_width() const
-{
- return width;
 }
 
-unsigned long int Image::get_height() const
+void Image_Cache::clear()
 {
- return height;
+ while (amount>0)
+ {
+  this->remove_entry(amount-1);
+ }
+ if (names!=NULL) delete[] names;
+ if (name_hashes!=NULL) delete[] name_hashes;
+ if (content_hashes!=NULL) delete[] content_hashes;
+ if (storages!=NULL) delete[] storages;
+ names=NULL;
+ name_hashes=NULL;
+ content_hashes=NULL;
+ storages=NULL;
+ capacity=0;
+ hits=0;
 }
 
-size_t Image::get_length() const
+size_t Image_Cache::get_amount() const
 {
- return static_cast<size_t>(width)*static_cast<size_t>(height)*3;
+ return amount;
 }
 
-unsigned char *Image::get_data()
+unsigned long int Image_Cache::get_hits() const
 {
- return data;
+ return hits;
 }
 
-void Image::destroy_image()
+Image_Cache* Image_Cache::get_handle()
 {
- width=0;
- height=0;
- this->clear_buffer();
+ return this;
 }
 
 Surface::Surface()
 {
  width=0;
  height=0;
+ revision=0;
  image=NULL;
  surface=NULL;
+ link=NULL;
+ mapped=false;
+ storage=NULL;
 }
 
 Surface::~Surface()
 {
+ this->flush();
+ this->release_buffer();
+ if (link!=NULL) release_link(link);
+ link=NULL;
  surface=NULL;
- if (image!=NULL) free(image);
 }
 
-IMG_Pixel *Surface::create_buffer(const unsigned long int image_width,const unsigned long int image_height)
+void Surface::release_buffer()
+{
+ if (storage!=NULL)
+ {
+  release_storage(storage);
+  storage=NULL;
+  image=NULL;
+ }
+ if (image!=NULL)
+ {
+  if (mapped==false) free_aligned(image);
+  image=NULL;
+ }
+ mapped=false;
+}
+
+void Surface::unshare_buffer()
+{
+ unsigned int *copy;
+ bool shared;
+ shared=mapped;
+ if (storage!=NULL)
+ {
+  if (InterlockedCompareExchange(&storage->references,0,0)>1) shared=true;
+ }
+ if ((shared==true)&&(image!=NULL))
+ {
+  copy=this->create_buffer(width,height);
+  memcpy(copy,image,static_cast<size_t>(width)*static_cast<size_t>(height)*sizeof(unsigned int));
+  this->release_buffer();
+  image=copy;
+  ++revision;
+ }
+
+}
+
+unsigned int *Surface::create_buffer(const unsigned long int image_width,const unsigned long int image_height)
 {
- IMG_Pixel *result;
+ unsigned int *result;
  size_t length;
  length=static_cast<size_t>(image_width)*static_cast<size_t>(image_height);
- result=reinterpret_cast<IMG_Pixel*>(calloc(length,3));
+ result=static_cast<unsigned int*>(allocate_aligned(length*sizeof(unsigned int),64));
  if (result==NULL)
  {
   Halt("Can't allocate memory for image buffer");
  }
+ memset(result,0,length*sizeof(unsigned int));
  return result;
 }
 
@@ -1935,23 +6505,78 @@ void Surface::restore()
  surface->restore();
 }
 
-void Surface::clear_buffer()
+void Surface::flush()
 {
- if (image!=NULL)
+ if (link!=NULL)
  {
-  free(image);
-  image=NULL;
+  if (link->frame!=NULL) link->frame->flush();
  }
 
 }
 
+void Surface::clear_buffer()
+{
+ this->flush();
+ this->release_buffer();
+ ++revision;
+}
+
 void Surface::load_from_buffer(Image &buffer)
 {
+ this->clear_buffer();
  width=buffer.get_width();
  height=buffer.get_height();
- this->clear_buffer();
  image=this->create_buffer(width,height);
- memmove(image,buffer.get_data(),buffer.get_length());
+ convert_image(image,buffer.get_data(),static_cast<size_t>(width)*static_cast<size_t>(height),buffer.get_depth());
+}
+
+void Surface::load_from_pack(Pack_File &pack,const char *name)
+{
+ if (pack.find(name)==false)
+ {
+  Halt("Can't find the image in the pack");
+ }
+ this->clear_buffer();
+ width=pack.get_width();
+ height=pack.get_height();
+ image=pack.get_pixels();
+ mapped=true;
+}
+
+void Surface::load_from_cache(Image_Cache &cache,const char *name)
+{
+ Pixel_Storage *target;
+ target=cache.get_storage(name);
+ this->clear_buffer();
+ retain_storage(target);
+ storage=target;
+ image=target->pixels;
+ width=target->width;
+ height=target->height;
+}
+
+void Surface::share_buffer(Surface &target)
+{
+ if (&target!=this)
+ {
+  if ((target.storage==NULL)&&(target.mapped==false)&&(target.image!=NULL))
+  {
+   target.storage=create_storage(target.image,target.width,target.height);
+  }
+  this->clear_buffer();
+  width=target.width;
+  height=target.height;
+  image=target.image;
+  mapped=target.mapped;
+  storage=target.storage;
+  if (storage!=NULL) retain_storage(storage);
+ }
+
+}
+
+const unsigned int *Surface::read_image() const
+{
+ return image;
 }
 
 void Surface::set_width(const unsigned long int image_width)
@@ -1964,9 +6589,13 @@ void Surface::set_height(const unsigned long int image_height)
  height=image_height;
 }
 
-void Surface::set_buffer(IMG_Pixel *buffer)
+void Surface::set_buffer(unsigned int *buffer)
 {
+ this->flush();
+ if (buffer!=image) this->release_buffer();
  image=buffer;
+ mapped=false;
+ ++revision;
 }
 
 size_t Surface::get_offset(const unsigned long int start,const unsigned long int x,const unsigned long int y,const unsigned long int target_width)
@@ -1981,30 +6610,32 @@ size_t Surface::get_offset(const unsigned long int start,const unsigned long int
 
 void Surface::draw_image_pixel(const size_t offset,const unsigned long int x,const unsigned long int y)
 {
- surface->draw_pixel(x,y,image[offset].red,image[offset].green,image[offset].blue);
+ surface->draw_pixel(x,y,image[offset]);
+}
+
+void Surface::draw_image(const size_t offset,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height)
+{
+ surface->draw_image(image+offset,width,x,y,image_width,image_height);
+}
+
+void Surface::draw_encoded_image(const size_t offset,const Opaque_Run *runs,const size_t *lines,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height)
+{
+ surface->draw_encoded_image(image+offset,width,runs,lines,x,y,image_width,image_height);
+}
+
+void Surface::draw_blended_image(const size_t offset,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height,const BLENDING_TYPE kind)
+{
+ surface->draw_blended_image(image+offset,width,x,y,image_width,image_height,kind);
+}
+
+void Surface::draw_transparent_image(const size_t offset,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height)
+{
+ surface->draw_transparent_image(image+offset,width,x,y,image_width,image_height,image[0]);
 }
 
 bool Surface::compare_pixels(const size_t first,const size_t second) const
 {
- bool result;
- result=false;
- if (image[first].red!=image[second].red)
- {
-  result=true;
-  goto finish;
- }
- if (image[first].green!=image[second].green)
- {
-  result=true;
-  goto finish;
- }
- if (image[first].blue!=image[second].blue)
- {
-  result=true;
-  goto finish;
- }
- finish: ;
- return result;
+ return image[first]!=image[second];
 }
 
 unsigned long int Surface::get_surface_width() const
@@ -2017,18 +6648,33 @@ unsigned long int Surface::get_surface_height() const
  return surface->get_frame_width();
 }
 
-void Surface::initialize(Screen *screen)
+unsigned long int Surface::get_revision() const
+{
+ return revision;
+}
+
+void Surface::initialize(Frame *screen)
 {
+ if (link!=NULL) release_link(link);
+ link=NULL;
  surface=screen;
+ if (surface!=NULL)
+ {
+  link=surface->get_link();
+  InterlockedIncrement(&link->references);
+ }
+
 }
 
 size_t Surface::get_length() const
 {
- return static_cast<size_t>(width)*static_cast<size_t>(height)*3;
+ return static_cast<size_t>(width)*static_cast<size_t>(height)*sizeof(unsigned int);
 }
 
-IMG_Pixel *Surface::get_image()
+unsigned int *Surface::get_image()
 {
+ this->flush();
+ this->unshare_buffer();
  return image;
 }
 
@@ -2045,7 +6691,8 @@ unsigned long int Surface::get_image_height() const
 void Surface::mirror_image(const MIRROR_TYPE kind)
 {
  unsigned long int x,y,index;
- IMG_Pixel *mirrored_image;
+ unsigned int *mirrored_image;
+ this->flush();
  x=0;
  y=0;
  mirrored_image=this->create_buffer(width,height);
@@ -2079,8 +6726,9 @@ void Surface::mirror_image(const MIRROR_TYPE kind)
   }
 
  }
- free(image);
+ this->release_buffer();
  image=mirrored_image;
+ ++revision;
 }
 
 void Surface::resize_image(const unsigned long int new_width,const unsigned long int new_height)
@@ -2088,7 +6736,8 @@ void Surface::resize_image(const unsigned long int new_width,const unsigned long
  float x_ratio,y_ratio;
  unsigned long int x,y;
  size_t index,position;
- IMG_Pixel *scaled_image;
+ unsigned int *scaled_image;
+ this->flush();
  scaled_image=this->create_buffer(new_width,new_height);
  x_ratio=static_cast<float>(width)/static_cast<float>(new_width);
  y_ratio=static_cast<float>(height)/static_cast<float>(new_height);
@@ -2102,10 +6751,43 @@ void Surface::resize_image(const unsigned long int new_width,const unsigned long
   }
 
  }
- free(image);
+ this->release_buffer();
  image=scaled_image;
  width=new_width;
  height=new_height;
+ ++revision;
+}
+
+void Surface::resize_image(const unsigned long int new_width,const unsigned long int new_height,const FILTER_TYPE kind)
+{
+ Processor processor;
+ Thread_Pool workers;
+ Thread_Pool *pool;
+ Filter filter;
+ unsigned int *scaled_image;
+ if (kind==NEAREST_FILTER)
+ {
+  this->resize_image(new_width,new_height);
+ }
+ else
+ {
+  this->flush();
+  pool=NULL;
+  if ((static_cast<size_t>(new_width)*static_cast<size_t>(new_height)>=262144)&&(processor.get_threads()>1))
+  {
+   workers.create(processor.get_threads()-1);
+   pool=&workers;
+  }
+  scaled_image=this->create_buffer(new_width,new_height);
+  filter.set_kind(kind);
+  filter.scale(scaled_image,new_width,new_height,image,width,height,pool);
+  this->release_buffer();
+  image=scaled_image;
+  width=new_width;
+  height=new_height;
+  ++revision;
+ }
+
 }
 
 void Surface::horizontal_mirror()
@@ -2169,6 +6851,16 @@ void Canvas::load_image(Image &buffer)
  this->load_from_buffer(buffer);
 }
 
+void Canvas::load_image(Pack_File &pack,const char *name)
+{
+ this->load_from_pack(pack,name);
+}
+
+void Canvas::load_image(Image_Cache &cache,const char *name)
+{
+ this->load_from_cache(cache,name);
+}
+
 Background::Background()
 {
  background_width=0;
@@ -2206,21 +6898,7 @@ void Background::get_maximum_height()
 
 void Background::slow_draw_background()
 {
- unsigned long int x,y,index;
- x=0;
- y=0;
- for (index=maximum_width*maximum_height;index>0;--index)
- {
-  this->draw_image_pixel(this->get_offset(start,x,y),x,y);
-  ++x;
-  if (x==maximum_width)
-  {
-   x=0;
-   ++y;
-  }
-
- }
-
+ this->draw_image(start,0,0,maximum_width,maximum_height);
 }
 
 void Background::configure_background()
@@ -2305,52 +6983,147 @@ Sprite::Sprite()
  sprite_width=0;
  sprite_height=0;
  current_kind=SINGLE_SPRITE;
+ blending=NO_BLENDING;
+ runs=NULL;
+ lines=NULL;
+ encoded_revision=0;
+ encoded_frames=0;
+ encoded_kind=SINGLE_SPRITE;
+}
+
+Sprite::~Sprite()
+{
+ this->flush();
+ this->destroy_runs();
+}
+
+void Sprite::destroy_runs()
+{
+ if (runs!=NULL)
+ {
+  delete[] runs;
+  runs=NULL;
+ }
+ if (lines!=NULL)
+ {
+  delete[] lines;
+  lines=NULL;
+ }
+
+}
+
+size_t Sprite::get_frame_start(const unsigned long int target) const
+{
+ size_t result;
+ result=0;
+ if (current_kind==HORIZONTAL_STRIP) result=static_cast<size_t>(target-1)*static_cast<size_t>(sprite_width);
+ if (current_kind==VERTICAL_STRIP) result=static_cast<size_t>(target-1)*static_cast<size_t>(sprite_width)*static_cast<size_t>(sprite_height);
+ return result;
+}
+
+size_t Sprite::scan_runs(const bool store)
+{
+ unsigned long int target,x,y,first;
+ size_t amount,line,row;
+ const unsigned int *image;
+ unsigned int key;
+ amount=0;
+ line=0;
+ image=this->read_image();
+ key=image[0];
+ for (target=1;target<=this->get_frames();++target)
+ {
+  row=this->get_frame_start(target);
+  for (y=0;y<sprite_height;++y)
+  {
+   if (store==true) lines[line]=amount;
+   ++line;
+   x=0;
+   while (x<sprite_width)
+   {
+    while ((x<sprite_width)&&(image[row+x]==key)) ++x;
+    first=x;
+    while ((x<sprite_width)&&(image[row+x]!=key)) ++x;
+    if (x>first)
+    {
+     if (store==true)
+     {
+      runs[amount].offset=first;
+      runs[amount].length=x-first;
+     }
+     ++amount;
+    }
+
+   }
+   row+=this->get_image_width();
+  }
+
+ }
+ if (store==true) lines[line]=amount;
+ return amount;
+}
+
+void Sprite::encode_sprite()
+{
+ size_t amount;
+ this->flush();
+ this->destroy_runs();
+ amount=this->scan_runs(false);
+ try
+ {
+  lines=new size_t[static_cast<size_t>(this->get_frames())*static_cast<size_t>(sprite_height)+1];
+  runs=new Opaque_Run[amount+1];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for sprite runs");
+ }
+ this->scan_runs(true);
+ encoded_revision=this->get_revision();
+ encoded_frames=this->get_frames();
+ encoded_kind=current_kind;
+}
+
+bool Sprite::check_encoding() const
+{
+ bool result;
+ result=false;
+ if (lines!=NULL)
+ {
+  result=(encoded_revision==this->get_revision())&&(encoded_frames==this->get_frames())&&(encoded_kind==current_kind);
+ }
+ return result;
 }
 
-Sprite::~Sprite()
+void Sprite::draw_encoded_sprite()
 {
-
+ size_t line;
+ if (this->check_encoding()==false) this->encode_sprite();
+ line=static_cast<size_t>(this->get_frame()-1)*static_cast<size_t>(sprite_height);
+ this->draw_encoded_image(start,runs,lines+line,current_x,current_y,sprite_width,sprite_height);
 }
 
 void Sprite::draw_transparent_sprite()
 {
- unsigned long int x,y,index;
- x=0;
- y=0;
- for (index=sprite_width*sprite_height;index>0;--index)
+ if (current_kind==SINGLE_SPRITE)
  {
-  if (this->compare_pixels(0,this->get_offset(start,x,y))==true)
-  {
-   this->draw_image_pixel(this->get_offset(start,x,y),x+current_x,y+current_y);
-  }
-  ++x;
-  if (x==sprite_width)
-  {
-   x=0;
-   ++y;
-  }
-
+  this->draw_transparent_image(start,current_x,current_y,sprite_width,sprite_height);
+ }
+ else
+ {
+  this->draw_encoded_sprite();
  }
 
 }
 
 void Sprite::draw_normal_sprite()
 {
- unsigned long int x,y,index;
- x=0;
- y=0;
- for (index=sprite_width*sprite_height;index>0;--index)
- {
-  this->draw_image_pixel(this->get_offset(start,x,y),x+current_x,y+current_y);
-  ++x;
-  if (x==sprite_width)
-  {
-   x=0;
-   ++y;
-  }
-
- }
+ this->draw_image(start,current_x,current_y,sprite_width,sprite_height);
+}
 
+void Sprite::draw_blended_sprite()
+{
+ this->draw_blended_image(start,current_x,current_y,sprite_width,sprite_height,blending);
 }
 
 void Sprite::load_sprite(Image &buffer,const SPRITE_TYPE kind,const unsigned long int frames)
@@ -2358,6 +7131,23 @@ void Sprite::load_sprite(Image &buffer,const SPRITE_TYPE kind,const unsigned lon
  this->load_image(buffer);
  if (kind!=SINGLE_SPRITE) this->set_frames(frames);
  this->set_kind(kind);
+ if (kind!=SINGLE_SPRITE) this->encode_sprite();
+}
+
+void Sprite::load_sprite(Pack_File &pack,const char *name,const SPRITE_TYPE kind,const unsigned long int frames)
+{
+ this->load_image(pack,name);
+ if (kind!=SINGLE_SPRITE) this->set_frames(frames);
+ this->set_kind(kind);
+ if (kind!=SINGLE_SPRITE) this->encode_sprite();
+}
+
+void Sprite::load_sprite(Image_Cache &cache,const char *name,const SPRITE_TYPE kind,const unsigned long int frames)
+{
+ this->load_image(cache,name);
+ if (kind!=SINGLE_SPRITE) this->set_frames(frames);
+ this->set_kind(kind);
+ if (kind!=SINGLE_SPRITE) this->encode_sprite();
 }
 
 void Sprite::set_transparent(const bool enabled)
@@ -2370,6 +7160,16 @@ bool Sprite::get_transparent() const
  return transparent;
 }
 
+void Sprite::set_blending(const BLENDING_TYPE kind)
+{
+ blending=kind;
+}
+
+BLENDING_TYPE Sprite::get_blending() const
+{
+ return blending;
+}
+
 void Sprite::set_x(const unsigned long int x)
 {
  current_x=x;
@@ -2503,24 +7303,30 @@ void Sprite::set_position(const unsigned long int x,const unsigned long int y)
 
 void Sprite::clone(Sprite &target)
 {
- this->set_width(target.get_image_width());
- this->set_height(target.get_image_height());
+ this->share_buffer(target);
  this->set_frames(target.get_frames());
  this->set_kind(target.get_kind());
  this->set_transparent(target.get_transparent());
- this->set_buffer(this->create_buffer(target.get_image_width(),target.get_image_width()));
- memmove(this->get_image(),target.get_image(),target.get_length());
+ this->set_blending(target.get_blending());
 }
 
 void Sprite::draw_sprite()
 {
- if (transparent==true)
+ if (blending!=NO_BLENDING)
  {
-  this->draw_transparent_sprite();
+  this->draw_blended_sprite();
  }
  else
  {
-  this->draw_normal_sprite();
+  if (transparent==true)
+  {
+   this->draw_transparent_sprite();
+  }
+  else
+  {
+   this->draw_normal_sprite();
+  }
+
  }
 
 }
@@ -2588,21 +7394,7 @@ void Tileset::select_tile(const unsigned long int row,const unsigned long int co
 
 void Tileset::draw_tile(const unsigned long int x,const unsigned long int y)
 {
- unsigned long int tile_x,tile_y,index;
- tile_x=0;
- tile_y=0;
- for (index=tile_width*tile_height;index>0;--index)
- {
-  this->draw_image_pixel(offset+this->get_offset(0,tile_x,tile_y),x+tile_x,y+tile_y);
-  ++tile_x;
-  if (tile_x==tile_width)
-  {
-   tile_x=0;
-   ++tile_y;
-  }
-
- }
-
+ this->draw_image(offset,x,y,tile_width,tile_height);
 }
 
 void Tileset::draw_tile(const unsigned long int row,const unsigned long int column,const unsigned long int x,const unsigned long int y)
@@ -2624,6 +7416,399 @@ void Tileset::load_tileset(Image &buffer,const unsigned long int row_amount,cons
 
 }
 
+void Tileset::load_tileset(Pack_File &pack,const char *name,const unsigned long int row_amount,const unsigned long int column_amount)
+{
+ if ((row_amount>0)&&(column_amount>0))
+ {
+  this->load_from_pack(pack,name);
+  rows=row_amount;
+  columns=column_amount;
+  tile_width=this->get_image_width()/rows;
+  tile_height=this->get_image_height()/columns;
+ }
+
+}
+
+void Tileset::load_tileset(Image_Cache &cache,const char *name,const unsigned long int row_amount,const unsigned long int column_amount)
+{
+ if ((row_amount>0)&&(column_amount>0))
+ {
+  this->load_from_cache(cache,name);
+  rows=row_amount;
+  columns=column_amount;
+  tile_width=this->get_image_width()/rows;
+  tile_height=this->get_image_height()/columns;
+ }
+
+}
+
+Asset_Loader::Asset_Loader()
+{
+ threads=NULL;
+ finished=NULL;
+ queued=NULL;
+ states=NULL;
+ orders=NULL;
+ stopping=0;
+ formats=NULL;
+ names=NULL;
+ images=NULL;
+ capacity=0;
+ amount=64;
+ workers=0;
+ active=0;
+ order=0;
+}
+
+Asset_Loader::~Asset_Loader()
+{
+ this->stop();
+}
+
+char *Asset_Loader::create_name(const size_t size)
+{
+ char *target;
+ target=NULL;
+ try
+ {
+  target=new char[size+1];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for asset file name");
+ }
+ return target;
+}
+
+void Asset_Loader::create_slots()
+{
+ size_t index;
+ capacity=amount;
+ try
+ {
+  finished=new HANDLE[capacity];
+  states=new LONG[capacity];
+  orders=new LONG[capacity];
+  formats=new IMAGE_FORMAT[capacity];
+  names=new char*[capacity];
+  images=new Image[capacity];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for asset loader");
+ }
+ for (index=0;index<capacity;++index)
+ {
+  states[index]=ASSET_FREE;
+  orders[index]=0;
+  formats[index]=TGA_IMAGE;
+  names[index]=NULL;
+  finished[index]=CreateEvent(NULL,TRUE,FALSE,NULL);
+  if (finished[index]==NULL)
+  {
+   Halt("Can't create synchronization objects for asset loader");
+  }
+
+ }
+
+}
+
+void Asset_Loader::destroy_slots()
+{
+ size_t index;
+ for (index=0;index<capacity;++index)
+ {
+  CloseHandle(finished[index]);
+  if (names[index]!=NULL) delete[] names[index];
+ }
+ delete[] finished;
+ delete[] states;
+ delete[] orders;
+ delete[] formats;
+ delete[] names;
+ delete[] images;
+ finished=NULL;
+ states=NULL;
+ orders=NULL;
+ formats=NULL;
+ names=NULL;
+ images=NULL;
+ capacity=0;
+}
+
+void Asset_Loader::start()
+{
+ Processor processor;
+ unsigned long int index;
+ this->create_slots();
+ active=workers;
+ if (active==0)
+ {
+  active=1;
+  if (processor.get_threads()>1) active=processor.get_threads()-1;
+ }
+ queued=CreateSemaphore(NULL,0,static_cast<LONG>(capacity+active),NULL);
+ if (queued==NULL)
+ {
+  Halt("Can't create synchronization objects for asset loader");
+ }
+ try
+ {
+  threads=new HANDLE[active];
+ }
+ catch (...)
+ {
+  Halt("Can't allocate memory for asset loader threads");
+ }
+ stopping=0;
+ order=0;
+ for (index=0;index<active;++index)
+ {
+  threads[index]=CreateThread(NULL,0,Asset_Loader::load_assets,this,0,NULL);
+  if (threads[index]==NULL)
+  {
+   Halt("Can't create asset loader thread");
+  }
+
+ }
+
+}
+
+size_t Asset_Loader::find_slot() const
+{
+ size_t index,slot;
+ slot=capacity;
+ for (index=0;index<capacity;++index)
+ {
+  if (InterlockedCompareExchange(&states[index],0,0)==ASSET_FREE)
+  {
+   slot=index;
+   break;
+  }
+
+ }
+ if (slot==capacity)
+ {
+  Halt("Asset loader queue is full");
+ }
+ return slot;
+}
+
+size_t Asset_Loader::take_slot()
+{
+ size_t index,slot;
+ LONG first,current;
+ slot=capacity;
+ while (slot==capacity)
+ {
+  first=0;
+  for (index=0;index<capacity;++index)
+  {
+   if (InterlockedCompareExchange(&states[index],0,0)==ASSET_QUEUED)
+   {
+    current=InterlockedCompareExchange(&orders[index],0,0);
+    if ((slot==capacity)||(current<first))
+    {
+     slot=index;
+     first=current;
+    }
+
+   }
+
+  }
+  if (slot!=capacity)
+  {
+   if (InterlockedCompareExchange(&states[slot],ASSET_LOADING,ASSET_QUEUED)!=ASSET_QUEUED) slot=capacity;
+  }
+
+ }
+ return slot;
+}
+
+void Asset_Loader::load_slot(const size_t slot)
+{
+ LONG state;
+ state=ASSET_FAILED;
+ if (formats[slot]==TGA_IMAGE)
+ {
+  if (images[slot].check_tga(names[slot])==true)
+  {
+   images[slot].load_tga(names[slot]);
+   state=ASSET_READY;
+  }
+
+ }
+ if (formats[slot]==PCX_IMAGE)
+ {
+  if (images[slot].check_pcx(names[slot])==true)
+  {
+   images[slot].load_pcx(names[slot]);
+   state=ASSET_READY;
+  }
+
+ }
+ InterlockedExchange(&states[slot],state);
+ SetEvent(finished[slot]);
+}
+
+void Asset_Loader::check_handle(const unsigned long int handle) const
+{
+ if ((threads==NULL)||(handle>=capacity))
+ {
+  Halt("Invalid asset handle");
+ }
+ if (InterlockedCompareExchange(&states[handle],0,0)==ASSET_FREE)
+ {
+  Halt("Invalid asset handle");
+ }
+
+}
+
+DWORD WINAPI Asset_Loader::load_assets(LPVOID target)
+{
+ Asset_Loader *loader;
+ loader=static_cast<Asset_Loader*>(target);
+ while (true)
+ {
+  WaitForSingleObject(loader->queued,INFINITE);
+  if (InterlockedCompareExchange(&loader->stopping,0,0)!=0) break;
+  loader->load_slot(loader->take_slot());
+ }
+ return 0;
+}
+
+void Asset_Loader::set_capacity(const size_t slot_amount)
+{
+ if (slot_amount>0) amount=slot_amount;
+}
+
+void Asset_Loader::set_workers(const unsigned long int thread_amount)
+{
+ workers=thread_amount;
+}
+
+void Asset_Loader::stop()
+{
+ unsigned long int index;
+ if (threads!=NULL)
+ {
+  InterlockedExchange(&stopping,1);
+  ReleaseSemaphore(queued,static_cast<LONG>(active),NULL);
+  for (index=0;index<active;++index)
+  {
+   WaitForSingleObject(threads[index],INFINITE);
+   CloseHandle(threads[index]);
+  }
+  delete[] threads;
+  threads=NULL;
+  CloseHandle(queued);
+  queued=NULL;
+  this->destroy_slots();
+ }
+
+}
+
+unsigned long int Asset_Loader::load(const char *name,const IMAGE_FORMAT kind)
+{
+ size_t slot;
+ if (threads==NULL) this->start();
+ slot=this->find_slot();
+ names[slot]=this->create_name(strlen(name));
+ strcpy(names[slot],name);
+ formats[slot]=kind;
+ ResetEvent(finished[slot]);
+ ++order;
+ InterlockedExchange(&orders[slot],order);
+ InterlockedExchange(&states[slot],ASSET_QUEUED);
+ ReleaseSemaphore(queued,1,NULL);
+ return static_cast<unsigned long int>(slot);
+}
+
+bool Asset_Loader::check_ready(const unsigned long int handle) const
+{
+ bool result;
+ result=false;
+ if ((threads!=NULL)&&(handle<capacity))
+ {
+  result=InterlockedCompareExchange(&states[handle],0,0)==ASSET_READY;
+ }
+ return result;
+}
+
+bool Asset_Loader::check_failed(const unsigned long int handle) const
+{
+ bool result;
+ result=false;
+ if ((threads!=NULL)&&(handle<capacity))
+ {
+  result=InterlockedCompareExchange(&states[handle],0,0)==ASSET_FAILED;
+ }
+ return result;
+}
+
+bool Asset_Loader::wait(const unsigned long int handle)
+{
+ this->check_handle(handle);
+ WaitForSingleObject(finished[handle],INFINITE);
+ return InterlockedCompareExchange(&states[handle],0,0)==ASSET_READY;
+}
+
+Image* Asset_Loader::get_image(const unsigned long int handle)
+{
+ if (this->wait(handle)==false)
+ {
+  Halt("Can't load the image");
+ }
+ return images+handle;
+}
+
+void Asset_Loader::release(const unsigned long int handle)
+{
+ this->wait(handle);
+ images[handle].destroy_image();
+ delete[] names[handle];
+ names[handle]=NULL;
+ InterlockedExchange(&states[handle],ASSET_FREE);
+}
+
+void Asset_Loader::deliver(const unsigned long int handle,Canvas &target)
+{
+ target.load_image(*this->get_image(handle));
+ this->release(handle);
+}
+
+void Asset_Loader::deliver(const unsigned long int handle,Sprite &target,const SPRITE_TYPE kind,const unsigned long int frames)
+{
+ target.load_sprite(*this->get_image(handle),kind,frames);
+ this->release(handle);
+}
+
+void Asset_Loader::deliver(const unsigned long int handle,Tileset &target,const unsigned long int row_amount,const unsigned long int column_amount)
+{
+ target.load_tileset(*this->get_image(handle),row_amount,column_amount);
+ this->release(handle);
+}
+
+unsigned long int Asset_Loader::get_pending() const
+{
+ unsigned long int result;
+ size_t index;
+ LONG state;
+ result=0;
+ for (index=0;index<capacity;++index)
+ {
+  state=InterlockedCompareExchange(&states[index],0,0);
+  if ((state==ASSET_QUEUED)||(state==ASSET_LOADING)) ++result;
+ }
+ return result;
+}
+
+Asset_Loader* Asset_Loader::get_handle()
+{
+ return this;
+}
+
+
 Text::Text()
 {
  current_x=0;
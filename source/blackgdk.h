@@ -20,6 +20,8 @@ freely, subject to the following restrictions:
 
 #pragma comment(lib,"kernel32.lib")
 #pragma comment(lib,"user32.lib")
+#pragma comment(lib,"gdi32.lib")
+#pragma comment(lib,"winmm.lib")
 #pragma comment(lib,"ole32.lib")
 #pragma comment(lib,"strmiids.lib")
 #pragma comment(lib,"d2d1.lib")
@@ -41,17 +43,49 @@ freely, subject to the following restrictions:
 #include <wchar.h>
 #include <new>
 #include <windows.h>
+#include <mmsystem.h>
 #include <unknwn.h>
 #include <d2d1.h>
 #include <dshow.h>
 #include <xinput.h>
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BLACKGDK_SSE2
+#include <emmintrin.h>
+//MINGW can't align the stack for AVX registers
+#if (defined(__GNUC__) && !defined(__MINGW32__)) || (_MSC_VER>=1800)
+#define BLACKGDK_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef __GNUC__
+#define SSE2_CODE __attribute__((target("sse2")))
+#define AVX2_CODE __attribute__((target("avx,avx2")))
+#else
+#define SSE2_CODE
+#define AVX2_CODE
+#endif
+
 #define GETSCANCODE(argument) ((argument >> 16)&0x7f)
 #define MOUSE 3
 
 enum MIRROR_TYPE {MIRROR_HORIZONTAL=0,MIRROR_VERTICAL=1};
 enum BACKGROUND_TYPE {NORMAL_BACKGROUND=0,HORIZONTAL_BACKGROUND=1,VERTICAL_BACKGROUND=2};
 enum SPRITE_TYPE {SINGLE_SPRITE=0,HORIZONTAL_STRIP=1,VERTICAL_STRIP=2};
+enum BLENDING_TYPE {NO_BLENDING=0,NORMAL_BLENDING=1,ADDITIVE_BLENDING=2,MULTIPLY_BLENDING=3};
+enum FILTER_TYPE {NEAREST_FILTER=0,BILINEAR_FILTER=1,BOX_FILTER=2,EPX_FILTER=3};
+enum COMMAND_TYPE {COMMAND_IMAGE=0,COMMAND_TRANSPARENT=1,COMMAND_ENCODED=2,COMMAND_BLENDED=3,COMMAND_FILL=4,COMMAND_SAVE=5,COMMAND_RESTORE=6};
+enum PRESENTER_TYPE {DIRECT2D_PRESENTER=0,GDI_PRESENTER=1};
+enum PROFILE_PHASE {PROFILE_INPUT=0,PROFILE_UPDATE=1,PROFILE_DRAW=2,PROFILE_PRESENT=3,PROFILE_WAIT=4};
+enum CAPTURE_FORMAT {CAPTURE_TGA=0,CAPTURE_Y4M=1,CAPTURE_RGB=2};
+enum IMAGE_FORMAT {TGA_IMAGE=0,PCX_IMAGE=1};
+enum ASSET_STATE {ASSET_FREE=0,ASSET_QUEUED=1,ASSET_LOADING=2,ASSET_READY=3,ASSET_FAILED=4};
 enum SURFACE {SURFACE_SMALL=0,SURFACE_LARGE=1};
 enum MOUSE_BUTTON {MOUSE_LEFT=0,MOUSE_RIGHT=1,MOUSE_MIDDLE=2};
 enum GAMEPAD_DIRECTION {GAMEPAD_NEUTRAL_DIRECTION=0,GAMEPAD_NEGATIVE_DIRECTION=-1,GAMEPAD_POSITIVE_DIRECTION=1};
@@ -115,6 +149,83 @@ struct PCX_head
  unsigned char filled[54];
 };
 
+struct Pack_Head
+{
+ char signature[8];
+ unsigned int version;
+ unsigned int amount;
+ unsigned int buckets;
+ unsigned int reserved[3];
+};
+
+struct Pack_Entry
+{
+ unsigned int hash;
+ unsigned int name_offset;
+ unsigned int name_length;
+ unsigned int width;
+ unsigned int height;
+ unsigned int used;
+ unsigned long long int offset;
+};
+
+struct Pixel_Storage
+{
+ volatile LONG references;
+ unsigned long int width;
+ unsigned long int height;
+ unsigned int *pixels;
+};
+
+struct Opaque_Run
+{
+ unsigned long int offset;
+ unsigned long int length;
+};
+
+struct Draw_Command
+{
+ COMMAND_TYPE kind;
+ BLENDING_TYPE blending;
+ unsigned int color;
+ const unsigned int *image;
+ unsigned long int image_width;
+ const Opaque_Run *runs;
+ const size_t *lines;
+ unsigned long int x;
+ unsigned long int y;
+ unsigned long int width;
+ unsigned long int height;
+ unsigned long int layer;
+ size_t order;
+};
+
+struct Draw_Statistics
+{
+ size_t recorded;
+ size_t culled;
+ size_t merged;
+ size_t executed;
+ unsigned long int layers;
+};
+
+struct Profile_Record
+{
+ unsigned long long int start;
+ unsigned long long int length;
+ unsigned long long int phase_start[5];
+ unsigned long long int phase_length[5];
+};
+
+struct Profile_Statistics
+{
+ unsigned long long int average;
+ unsigned long long int median;
+ unsigned long long int percentile_95;
+ unsigned long long int percentile_99;
+ unsigned long long int maximum;
+};
+
 struct Collision_Box
 {
  unsigned long int x:32;
@@ -129,6 +240,9 @@ namespace BLACKGDK
 {
 
 void Halt(const char *message);
+void *allocate_aligned(const size_t size,const size_t alignment);
+void free_aligned(void *target);
+IMAGE_FORMAT get_image_format(const char *name);
 
 class COM_Base
 {
@@ -137,17 +251,132 @@ class COM_Base
  ~COM_Base();
 };
 
+class Clock
+{
+ private:
+ unsigned long long int frequency;
+ public:
+ Clock();
+ ~Clock();
+ unsigned long long int get_time() const;
+};
+
 class Synchronization
 {
  private:
  HANDLE timer;
+ Clock clock;
+ unsigned int resolution;
+ unsigned long int rate;
+ unsigned long int missed;
+ unsigned long long int period;
+ unsigned long long int deadline;
+ unsigned long long int spin;
+ void sleep(const unsigned long long int interval);
+ void adjust_spin(const unsigned long long int error);
  protected:
  void create_timer();
- void set_timer(const unsigned long int interval);
+ void start_timer();
  void wait_timer();
  public:
  Synchronization();
  ~Synchronization();
+ void set_rate(const unsigned long int fps);
+ unsigned long int get_rate() const;
+ unsigned long int get_missed() const;
+};
+
+class Processor
+{
+ private:
+ bool sse2;
+ bool avx2;
+ unsigned long int threads;
+ void detect();
+ public:
+ Processor();
+ ~Processor();
+ bool check_sse2() const;
+ bool check_avx2() const;
+ unsigned long int get_threads() const;
+};
+
+class Thread_Pool
+{
+ private:
+ HANDLE *threads;
+ HANDLE start;
+ HANDLE finish;
+ volatile LONG next;
+ volatile LONG active;
+ unsigned long int amount;
+ unsigned long int jobs;
+ bool stopping;
+ void (*task)(void *context,const unsigned long int index);
+ void *context;
+ static DWORD WINAPI work(LPVOID target);
+ void execute();
+ public:
+ Thread_Pool();
+ ~Thread_Pool();
+ void create(const unsigned long int workers);
+ void destroy();
+ unsigned long int get_amount() const;
+ void run(void (*job)(void *target,const unsigned long int index),void *target,const unsigned long int total);
+};
+
+class Filter
+{
+ private:
+ FILTER_TYPE kind;
+ FILTER_TYPE mode;
+ unsigned int *target;
+ const unsigned int *source;
+ unsigned long int target_width;
+ unsigned long int target_height;
+ unsigned long int source_width;
+ unsigned long int source_height;
+ unsigned long int target_stride;
+ unsigned long int source_stride;
+ unsigned long int bands;
+ unsigned long int *columns;
+ unsigned long int *weights;
+ FILTER_TYPE table_mode;
+ unsigned long int table_width;
+ unsigned long int table_length;
+ unsigned int **lines;
+ unsigned long int line_amount;
+ size_t line_length;
+ unsigned int *stages[2];
+ size_t stage_length[2];
+ void (*vertical_kernel)(unsigned int *target,const unsigned int *first,const unsigned int *second,const size_t length,const unsigned int weight);
+ void (*horizontal_kernel)(unsigned int *target,const unsigned int *source,const unsigned long int *columns,const unsigned long int *weights,const size_t length);
+ void (*box_kernel)(unsigned int *sum,const unsigned int *source,const size_t length);
+ void (*epx_kernel)(unsigned int *first_line,unsigned int *second_line,const unsigned int *up,const unsigned int *row,const unsigned int *down,const size_t width);
+ void select_kernels();
+ unsigned long int *create_table(const unsigned long int length);
+ void destroy_tables();
+ void prepare_tables();
+ void destroy_lines();
+ void prepare_lines();
+ void destroy_stages();
+ unsigned int *get_stage(const unsigned long int index,const size_t length);
+ unsigned long int get_units() const;
+ void nearest_rows(const unsigned long int first,const unsigned long int last);
+ void bilinear_rows(const unsigned long int first,const unsigned long int last,unsigned int *line);
+ void box_rows(const unsigned long int first,const unsigned long int last,unsigned int *sum);
+ void epx_rows(const unsigned long int first,const unsigned long int last);
+ void scale_band(const unsigned long int band);
+ static void run_band(void *target,const unsigned long int band);
+ void resample(const FILTER_TYPE filter,unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned long int output_stride,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,const unsigned long int input_stride,Thread_Pool *pool);
+ void enlarge(unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned long int output_stride,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,const unsigned long int input_stride,Thread_Pool *pool);
+ public:
+ Filter();
+ ~Filter();
+ void set_kind(const FILTER_TYPE filter);
+ FILTER_TYPE get_kind() const;
+ void scale(unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned long int output_stride,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,const unsigned long int input_stride,Thread_Pool *pool);
+ void scale(unsigned int *output,const unsigned long int output_width,const unsigned long int output_height,const unsigned int *input,const unsigned long int input_width,const unsigned long int input_height,Thread_Pool *pool);
 };
 
 class Engine
@@ -173,19 +402,80 @@ class Engine
  unsigned long int get_height();
 };
 
+class Region
+{
+ private:
+ Collision_Box boxes[32];
+ size_t amount;
+ bool check_contact(const Collision_Box &first,const Collision_Box &second) const;
+ Collision_Box merge_boxes(const Collision_Box &first,const Collision_Box &second) const;
+ size_t get_area(const Collision_Box &target) const;
+ void remove(const size_t index);
+ public:
+ Region();
+ ~Region();
+ void clear();
+ void add(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
+ void add(const Collision_Box &target);
+ size_t get_amount() const;
+ Collision_Box get_box(const size_t index) const;
+};
+
+class Frame;
+
+struct Frame_Link
+{
+ volatile LONG references;
+ Frame *frame;
+};
+
 class Frame
 {
  private:
+ bool tracking;
+ Frame_Link *link;
+ size_t traffic;
+ size_t last_traffic;
+ Region damage;
+ Region changes;
+ Thread_Pool workers;
+ unsigned long int bands;
+ bool deferred;
+ Draw_Command *commands;
+ size_t command_amount;
+ size_t command_capacity;
+ size_t command_barrier;
+ Draw_Statistics statistics;
+ Draw_Statistics last_statistics;
  size_t pixels;
+ size_t frame_length;
  unsigned long int frame_width;
  unsigned long int frame_height;
+ unsigned long int frame_stride;
  unsigned long int frame_line;
  unsigned int *buffer;
  unsigned int *shadow;
+ void (*transparent_kernel)(unsigned int *target,const unsigned int *source,const size_t length,const unsigned int key);
+ void (*blending_kernel[4])(unsigned int *target,const unsigned int *source,const size_t length);
+ void (*fill_kernel)(unsigned int *target,const size_t length,const unsigned int color);
+ void select_kernels();
  void calculate_buffer_length();
  unsigned int *get_memory(const char *error);
- void clear_buffer(unsigned int *target);
+ void clear_buffer(unsigned int *target,const unsigned int color);
  unsigned int *create_buffer(const char *error);
+ unsigned long int clip_width(const unsigned long int x,const unsigned long int width) const;
+ unsigned long int clip_height(const unsigned long int y,const unsigned long int height) const;
+ void mark(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
+ Draw_Command prepare_command(const COMMAND_TYPE kind,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height) const;
+ void grow_commands();
+ bool merge_command(const Draw_Command &command);
+ bool check_cover(const Draw_Command &command) const;
+ void record(const Draw_Command &command);
+ bool submit(Draw_Command &command);
+ void sort_commands();
+ void execute(const Draw_Command &command,const unsigned long int first,const unsigned long int last);
+ void draw_band(const unsigned long int band);
+ static void run_band(void *target,const unsigned long int band);
  protected:
  size_t get_offset(const unsigned long int x,const unsigned long int y,const unsigned long int target_width);
  size_t get_offset(const unsigned long int x,const unsigned long int y) const;
@@ -193,18 +483,46 @@ class Frame
  void set_size(const SURFACE surface);
  void create_buffers();
  unsigned long int get_frame_line() const;
+ unsigned int *get_frame_buffer();
+ Thread_Pool *get_workers();
+ bool check_tracking() const;
+ size_t get_damage_amount() const;
+ Collision_Box get_damage(const size_t index) const;
+ void add_traffic(const size_t amount);
+ void clear_damage();
  public:
  Frame();
  ~Frame();
  unsigned int *get_buffer();
+ unsigned int *get_buffer(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
+ Frame_Link *get_link();
  size_t get_pixels() const;
+ size_t get_traffic() const;
+ void invalidate();
+ void set_threads(const unsigned long int amount);
+ unsigned long int get_threads() const;
+ void set_deferred(const bool enabled);
+ bool get_deferred() const;
+ Draw_Statistics get_statistics() const;
+ void flush();
+ const unsigned int *read_buffer();
+ bool draw_pixel(const unsigned long int x,const unsigned long int y,const unsigned int color);
  bool draw_pixel(const unsigned long int x,const unsigned long int y,const unsigned long int red,const unsigned long int green,const unsigned long int blue);
+ void draw_image(const unsigned int *image,const unsigned long int image_width,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
+ void draw_transparent_image(const unsigned int *image,const unsigned long int image_width,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height,const unsigned int key);
+ void draw_encoded_image(const unsigned int *image,const unsigned long int image_width,const Opaque_Run *runs,const size_t *lines,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
+ void draw_blended_image(const unsigned int *image,const unsigned long int image_width,const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height,const BLENDING_TYPE kind);
  void clear_screen();
+ void clear_screen(const unsigned int color);
+ void clear_screen(const unsigned char red,const unsigned char green,const unsigned char blue);
  void save();
+ void swap();
  void restore();
  void restore(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
+ void restore(const Collision_Box *targets,const size_t amount);
  unsigned long int get_frame_width() const;
  unsigned long int get_frame_height() const;
+ unsigned long int get_frame_stride() const;
 };
 
 class Plane: public Frame
@@ -212,14 +530,29 @@ class Plane: public Frame
  private:
  unsigned int *plane;
  unsigned int *target;
+ Frame *target_frame;
  unsigned long int target_width;
  unsigned long int target_height;
+ unsigned long int target_stride;
  float x_ratio;
  float y_ratio;
+ unsigned long int *columns;
+ unsigned long int *rows;
+ unsigned long int scale;
+ void (*scale_kernel)(unsigned int *target,const unsigned int *source,const size_t length);
+ Filter filter;
+ void destroy_tables();
+ unsigned long int *create_table(const unsigned long int length,const float ratio);
+ void select_scale();
+ void scale_rows();
+ void prepare_plane(const unsigned long int width,const unsigned long int height,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_stride,unsigned int *surface_buffer);
  public:
  Plane();
  ~Plane();
  void create_plane(const unsigned long int width,const unsigned long int height,const unsigned long int surface_width,const unsigned long int surface_height,unsigned int *surface_buffer);
+ void create_plane(const unsigned long int width,const unsigned long int height,Frame *surface);
+ void set_filter(const FILTER_TYPE kind);
+ FILTER_TYPE get_filter() const;
  void transfer();
  Plane* get_handle();
 };
@@ -227,8 +560,9 @@ class Plane: public Frame
 class Timer
 {
  private:
- unsigned long int interval;
- time_t start;
+ Clock clock;
+ unsigned long long int interval;
+ unsigned long long int start;
  public:
  Timer();
  ~Timer();
@@ -250,6 +584,75 @@ class FPS
  unsigned long int get_fps() const;
 };
 
+class Simulation
+{
+ private:
+ Clock clock;
+ unsigned long long int step;
+ unsigned long long int accumulator;
+ unsigned long long int last;
+ unsigned long int limit;
+ unsigned long int dropped;
+ public:
+ Simulation();
+ ~Simulation();
+ void set_rate(const unsigned long int rate);
+ void set_limit(const unsigned long int amount);
+ void start();
+ unsigned long int update();
+ double get_alpha() const;
+ double get_delta() const;
+ unsigned long int get_dropped() const;
+};
+
+class Output_File;
+
+class Profiler
+{
+ private:
+ Clock clock;
+ Profile_Record *records;
+ unsigned long long int *samples;
+ Profile_Record current;
+ unsigned long long int opened[5];
+ size_t capacity;
+ size_t amount;
+ size_t position;
+ unsigned long int frames;
+ unsigned long long int *create_samples(const size_t length);
+ Profile_Record *create_records(const size_t length);
+ void destroy_storage();
+ void reset_record();
+ Profile_Record get_record(const size_t index) const;
+ Profile_Statistics calculate();
+ void write_text(Output_File &target,const char *text);
+ public:
+ Profiler();
+ ~Profiler();
+ void set_window(const size_t length);
+ size_t get_window() const;
+ void begin_zone(const PROFILE_PHASE phase);
+ void end_zone(const PROFILE_PHASE phase);
+ void next_frame();
+ size_t get_amount() const;
+ unsigned long int get_frames() const;
+ Profile_Statistics get_frame_statistics();
+ Profile_Statistics get_phase_statistics(const PROFILE_PHASE phase);
+ void save_csv(const char *name);
+ void save_trace(const char *name);
+ Profiler* get_handle();
+};
+
+class Profile_Zone
+{
+ private:
+ Profiler *profiler;
+ PROFILE_PHASE phase;
+ public:
+ Profile_Zone(Profiler *target,const PROFILE_PHASE kind);
+ ~Profile_Zone();
+};
+
 class Unicode_Convertor
 {
  private:
@@ -264,7 +667,20 @@ class Unicode_Convertor
  wchar_t *convert(const char *source);
 };
 
-class Render:public COM_Base, public Engine, public Frame
+class Presenter
+{
+ public:
+ Presenter();
+ virtual ~Presenter();
+ virtual void create(HWND handle,const unsigned long int window_width,const unsigned long int window_height,const unsigned int *surface_buffer,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_line)=0;
+ virtual void destroy()=0;
+ virtual void set_buffer(const unsigned int *surface_buffer)=0;
+ virtual size_t upload(const Collision_Box &target)=0;
+ virtual size_t upload()=0;
+ virtual bool present()=0;
+};
+
+class Direct2D_Presenter:public Presenter
 {
  private:
  ID2D1Factory *render;
@@ -275,34 +691,134 @@ class Render:public COM_Base, public Engine, public Frame
  D2D1_RECT_U source;
  D2D1_RECT_F destanation;
  D2D1_RECT_F texture;
+ const unsigned int *buffer;
+ unsigned long int line;
  void create_factory();
  void create_target();
  void create_surface();
- void set_render_setting();
- void set_render();
  void destroy_resource();
  void recreate_render();
- void prepare_surface();
+ public:
+ Direct2D_Presenter();
+ ~Direct2D_Presenter();
+ void create(HWND handle,const unsigned long int window_width,const unsigned long int window_height,const unsigned int *surface_buffer,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_line);
+ void destroy();
+ void set_buffer(const unsigned int *surface_buffer);
+ size_t upload(const Collision_Box &target);
+ size_t upload();
+ bool present();
+};
+
+class GDI_Presenter:public Presenter
+{
+ private:
+ HWND window;
+ HDC context;
+ BITMAPINFO setting;
+ const unsigned int *buffer;
+ unsigned long int width;
+ unsigned long int height;
+ unsigned long int frame_width;
+ unsigned long int frame_height;
+ void set_setting(const unsigned long int surface_line);
+ public:
+ GDI_Presenter();
+ ~GDI_Presenter();
+ void create(HWND handle,const unsigned long int window_width,const unsigned long int window_height,const unsigned int *surface_buffer,const unsigned long int surface_width,const unsigned long int surface_height,const unsigned long int surface_line);
+ void destroy();
+ void set_buffer(const unsigned int *surface_buffer);
+ size_t upload(const Collision_Box &target);
+ size_t upload();
+ bool present();
+};
+
+class Render:public COM_Base, public Engine, public Frame
+{
+ private:
+ Direct2D_Presenter direct2d;
+ GDI_Presenter gdi;
+ Presenter *presenter;
+ bool ready;
+ bool pipeline;
+ HANDLE thread;
+ HANDLE signal;
+ volatile LONG stopping;
+ volatile LONG published;
+ unsigned long int back;
+ unsigned long int front;
+ unsigned int *slots[3];
+ Region pending[3];
+ void start_presenter();
+ void change_presenter(Presenter *target);
+ unsigned int *create_slot();
+ void copy_slot(const Collision_Box &target);
+ void fill_slot();
+ void publish_slot();
+ void present_slot();
+ static DWORD WINAPI present_frames(LPVOID target);
+ void start_pipeline();
+ void stop_pipeline();
  protected:
  void create_render();
  void refresh();
  public:
  Render();
  ~Render();
+ void set_presenter(const PRESENTER_TYPE kind);
+ void set_presenter(Presenter *target);
+ Presenter* get_presenter();
+ void set_pipeline(const bool enabled);
+ bool get_pipeline() const;
 };
 
 class Screen:public FPS, public Synchronization, public Render
 {
+ private:
+ Profiler *profiler;
+ void present_frame();
+ void wait_frame();
  public:
  Screen();
  ~Screen();
  void initialize();
  void initialize(const SURFACE surface);
+ void initialize(const unsigned long int width,const unsigned long int height);
  bool update();
  bool sync();
+ void set_profiler(Profiler *target);
  Screen* get_handle();
 };
 
+class Offscreen:public FPS, public Frame
+{
+ private:
+ Clock counter;
+ unsigned long long int clock;
+ unsigned long long int start;
+ unsigned long int interval;
+ unsigned long int frames;
+ unsigned long int limit;
+ Profiler *profiler;
+ unsigned long long int get_counter() const;
+ void advance_clock();
+ void present_frame();
+ public:
+ Offscreen();
+ ~Offscreen();
+ void initialize();
+ void initialize(const SURFACE surface);
+ void initialize(const unsigned long int width,const unsigned long int height);
+ void set_clock(const unsigned long int step);
+ void set_limit(const unsigned long int amount);
+ unsigned long long int get_clock() const;
+ unsigned long int get_frames() const;
+ unsigned long long int get_checksum();
+ bool update();
+ bool sync();
+ void set_profiler(Profiler *target);
+ Offscreen* get_handle();
+};
+
 class Keyboard
 {
  private:
@@ -467,6 +983,7 @@ class Input_File:public Binary_File
  Input_File();
  ~Input_File();
  void open(const char *name);
+ bool try_open(const char *name);
  void read(void *buffer,const size_t length);
 };
 
@@ -481,15 +998,107 @@ class Output_File:public Binary_File
  void flush();
 };
 
+class Input_Buffer
+{
+ private:
+ Input_File *source;
+ unsigned char *buffer;
+ size_t amount;
+ size_t position;
+ size_t remain;
+ void create_buffer();
+ void fill();
+ public:
+ Input_Buffer();
+ ~Input_Buffer();
+ void open(Input_File *target,const size_t length);
+ void read(void *target,const size_t length);
+ void skip(const size_t length);
+ unsigned char read_byte();
+ size_t get_left() const;
+};
+
+class Mapped_File
+{
+ private:
+ HANDLE target;
+ HANDLE mapping;
+ unsigned char *view;
+ size_t length;
+ public:
+ Mapped_File();
+ ~Mapped_File();
+ void open(const char *name);
+ void close();
+ unsigned char *get_data();
+ size_t get_length() const;
+ bool check_open() const;
+};
+
+class Capture
+{
+ private:
+ HANDLE thread;
+ HANDLE ready;
+ volatile LONG filled;
+ volatile LONG written;
+ Frame *source;
+ Output_File stream;
+ CAPTURE_FORMAT format;
+ unsigned int **slots;
+ unsigned long int *numbers;
+ unsigned char *line;
+ char *name;
+ char *path;
+ size_t capacity;
+ size_t head;
+ size_t tail;
+ size_t length;
+ unsigned long int width;
+ unsigned long int height;
+ unsigned long int rate;
+ unsigned long int captured;
+ unsigned long int dropped;
+ size_t amount;
+ unsigned char *create_line(const size_t size);
+ char *create_name(const size_t size);
+ unsigned int *create_slot();
+ void create_slots();
+ void destroy_slots();
+ void copy_frame(unsigned int *target);
+ void write_header();
+ void write_tga(const unsigned int *frame,const unsigned long int number);
+ void write_plane(const unsigned int *frame,const unsigned long int plane);
+ void write_y4m(const unsigned int *frame);
+ void write_rgb(const unsigned int *frame);
+ void write_slot();
+ static DWORD WINAPI write_frames(LPVOID target);
+ public:
+ Capture();
+ ~Capture();
+ void set_slots(const size_t slot_amount);
+ void set_rate(const unsigned long int fps);
+ void start(Frame *target,const char *file,const CAPTURE_FORMAT kind);
+ void stop();
+ bool capture();
+ bool check_capture() const;
+ unsigned long int get_captured() const;
+ unsigned long int get_dropped() const;
+ unsigned long int get_written() const;
+ Capture* get_handle();
+};
+
 class Primitive
 {
  private:
  IMG_Pixel color;
- Screen *surface;
+ Frame *surface;
+ unsigned int get_pixel() const;
+ void plot(unsigned int *target,const unsigned long int x,const unsigned long int y,const unsigned int pixel);
  public:
  Primitive();
  ~Primitive();
- void initialize(Screen *screen);
+ void initialize(Frame *screen);
  void set_color(const unsigned char red,const unsigned char green,const unsigned char blue);
  void draw_line(const unsigned long int x1,const unsigned long int y1,const unsigned long int x2,const unsigned long int y2);
  void draw_rectangle(const unsigned long int x,const unsigned long int y,const unsigned long int width,const unsigned long int height);
@@ -501,53 +1110,143 @@ class Image
  private:
  unsigned long int width;
  unsigned long int height;
+ unsigned long int depth;
  unsigned char *data;
+ Mapped_File mapping;
  unsigned char *create_buffer(const size_t length);
  void clear_buffer();
+ void decode_tga(Input_Buffer &source,unsigned char *target,const size_t length);
+ void flip_image(unsigned char *target);
+ void decode_pcx(Input_Buffer &source,unsigned char *target,const size_t length,size_t &repeat,unsigned char &value);
  public:
  Image();
  ~Image();
+ bool check_tga(const char *name);
+ bool check_pcx(const char *name);
  void load_tga(const char *name);
  void load_pcx(const char *name);
  unsigned long int get_width() const;
  unsigned long int get_height() const;
+ unsigned long int get_depth() const;
  size_t get_length() const;
  unsigned char *get_data();
  void destroy_image();
 };
 
+class Pack_File
+{
+ private:
+ Mapped_File mapping;
+ Pack_Head *head;
+ Pack_Entry *entries;
+ Pack_Entry *current;
+ void check_pack();
+ public:
+ Pack_File();
+ ~Pack_File();
+ void open(const char *name);
+ void close();
+ bool find(const char *name);
+ unsigned long int get_amount() const;
+ unsigned long int get_width() const;
+ unsigned long int get_height() const;
+ unsigned int *get_pixels();
+ Pack_File* get_handle();
+};
+
+class Pack_Builder
+{
+ private:
+ char **names;
+ char **files;
+ IMAGE_FORMAT *formats;
+ size_t amount;
+ size_t capacity;
+ char *create_name(const char *name);
+ void resize_list();
+ void write_padding(Output_File &target,const size_t length);
+ public:
+ Pack_Builder();
+ ~Pack_Builder();
+ void add_image(const char *name,const char *file,const IMAGE_FORMAT kind);
+ void save(const char *name);
+ void clear();
+ size_t get_amount() const;
+};
+
+class Image_Cache
+{
+ private:
+ char **names;
+ unsigned int *name_hashes;
+ unsigned long long int *content_hashes;
+ Pixel_Storage **storages;
+ size_t amount;
+ size_t capacity;
+ unsigned long int hits;
+ void resize_list();
+ void remove_entry(const size_t index);
+ Pixel_Storage *find_content(const unsigned int *pixels,const unsigned long int width,const unsigned long int height,const unsigned long long int hash);
+ public:
+ Image_Cache();
+ ~Image_Cache();
+ Pixel_Storage *get_storage(const char *name);
+ void trim();
+ void clear();
+ size_t get_amount() const;
+ unsigned long int get_hits() const;
+ Image_Cache* get_handle();
+};
+
 class Surface
 {
  private:
- Screen *surface;
- IMG_Pixel *image;
+ Frame *surface;
+ Frame_Link *link;
+ unsigned int *image;
  unsigned long int width;
  unsigned long int height;
+ unsigned long int revision;
+ bool mapped;
+ Pixel_Storage *storage;
+ void release_buffer();
+ void unshare_buffer();
  protected:
  void save();
  void restore();
+ void flush();
  void clear_buffer();
- IMG_Pixel *create_buffer(const unsigned long int image_width,const unsigned long int image_height);
+ unsigned int *create_buffer(const unsigned long int image_width,const unsigned long int image_height);
  void load_from_buffer(Image &buffer);
+ void load_from_pack(Pack_File &pack,const char *name);
+ void load_from_cache(Image_Cache &cache,const char *name);
+ void share_buffer(Surface &target);
+ const unsigned int *read_image() const;
  void set_width(const unsigned long int image_width);
  void set_height(const unsigned long int image_height);
- void set_buffer(IMG_Pixel *buffer);
+ void set_buffer(unsigned int *buffer);
  size_t get_offset(const unsigned long int start,const unsigned long int x,const unsigned long int y,const unsigned long int target_width);
  size_t get_offset(const unsigned long int start,const unsigned long int x,const unsigned long int y) const;
  void draw_image_pixel(const size_t offset,const unsigned long int x,const unsigned long int y);
+ void draw_image(const size_t offset,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height);
+ void draw_transparent_image(const size_t offset,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height);
+ void draw_encoded_image(const size_t offset,const Opaque_Run *runs,const size_t *lines,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height);
+ void draw_blended_image(const size_t offset,const unsigned long int x,const unsigned long int y,const unsigned long int image_width,const unsigned long int image_height,const BLENDING_TYPE kind);
  bool compare_pixels(const size_t first,const size_t second) const;
  unsigned long int get_surface_width() const;
  unsigned long int get_surface_height() const;
+ unsigned long int get_revision() const;
  public:
  Surface();
  ~Surface();
- void initialize(Screen *screen);
+ void initialize(Frame *screen);
  size_t get_length() const;
- IMG_Pixel *get_image();
+ unsigned int *get_image();
  unsigned long int get_image_width() const;
  unsigned long int get_image_height() const;
  void mirror_image(const MIRROR_TYPE kind);
  void resize_image(const unsigned long int new_width,const unsigned long int new_height);
+ void resize_image(const unsigned long int new_width,const unsigned long int new_height,const FILTER_TYPE kind);
  void horizontal_mirror();
  void vertical_mirror();
 };
@@ -568,6 +1267,8 @@ class Canvas:public Surface
  unsigned long int get_frames() const;
  unsigned long int get_frame() const;
  void load_image(Image &buffer);
+ void load_image(Pack_File &pack,const char *name);
+ void load_image(Image_Cache &cache,const char *name);
 };
 
 class Background:public Canvas
@@ -604,14 +1305,31 @@ class Sprite:public Canvas
  unsigned long int sprite_width;
  unsigned long int sprite_height;
  SPRITE_TYPE current_kind;
+ BLENDING_TYPE blending;
+ Opaque_Run *runs;
+ size_t *lines;
+ unsigned long int encoded_revision;
+ unsigned long int encoded_frames;
+ SPRITE_TYPE encoded_kind;
+ void destroy_runs();
+ size_t get_frame_start(const unsigned long int target) const;
+ size_t scan_runs(const bool store);
+ void encode_sprite();
+ bool check_encoding() const;
+ void draw_encoded_sprite();
  void draw_transparent_sprite();
  void draw_normal_sprite();
+ void draw_blended_sprite();
  public:
  Sprite();
  ~Sprite();
  void load_sprite(Image &buffer,const SPRITE_TYPE kind,const unsigned long int frames);
+ void load_sprite(Pack_File &pack,const char *name,const SPRITE_TYPE kind,const unsigned long int frames);
+ void load_sprite(Image_Cache &cache,const char *name,const SPRITE_TYPE kind,const unsigned long int frames);
  void set_transparent(const bool enabled);
  bool get_transparent() const;
+ void set_blending(const BLENDING_TYPE kind);
+ BLENDING_TYPE get_blending() const;
  void set_x(const unsigned long int x);
  void set_y(const unsigned long int y);
  void increase_x();
@@ -659,6 +1377,53 @@ class Tileset:public Surface
  void draw_tile(const unsigned long int x,const unsigned long int y);
  void draw_tile(const unsigned long int row,const unsigned long int column,const unsigned long int x,const unsigned long int y);
  void load_tileset(Image &buffer,const unsigned long int row_amount,const unsigned long int column_amount);
+ void load_tileset(Pack_File &pack,const char *name,const unsigned long int row_amount,const unsigned long int column_amount);
+ void load_tileset(Image_Cache &cache,const char *name,const unsigned long int row_amount,const unsigned long int column_amount);
+};
+
+class Asset_Loader
+{
+ private:
+ HANDLE *threads;
+ HANDLE *finished;
+ HANDLE queued;
+ volatile LONG *states;
+ volatile LONG *orders;
+ volatile LONG stopping;
+ IMAGE_FORMAT *formats;
+ char **names;
+ Image *images;
+ size_t capacity;
+ size_t amount;
+ unsigned long int workers;
+ unsigned long int active;
+ LONG order;
+ char *create_name(const size_t size);
+ void create_slots();
+ void destroy_slots();
+ void start();
+ size_t find_slot() const;
+ size_t take_slot();
+ void load_slot(const size_t slot);
+ void check_handle(const unsigned long int handle) const;
+ static DWORD WINAPI load_assets(LPVOID target);
+ public:
+ Asset_Loader();
+ ~Asset_Loader();
+ void set_capacity(const size_t slot_amount);
+ void set_workers(const unsigned long int thread_amount);
+ void stop();
+ unsigned long int load(const char *name,const IMAGE_FORMAT kind);
+ bool check_ready(const unsigned long int handle) const;
+ bool check_failed(const unsigned long int handle) const;
+ bool wait(const unsigned long int handle);
+ Image* get_image(const unsigned long int handle);
+ void release(const unsigned long int handle);
+ void deliver(const unsigned long int handle,Canvas &target);
+ void deliver(const unsigned long int handle,Sprite &target,const SPRITE_TYPE kind,const unsigned long int frames);
+ void deliver(const unsigned long int handle,Tileset &target,const unsigned long int row_amount,const unsigned long int column_amount);
+ unsigned long int get_pending() const;
+ Asset_Loader* get_handle();
 };
 
 class Text
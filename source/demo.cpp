@@ -29,7 +29,7 @@ int main()
  text.load_font(font.get_handle());
  text.set_position(font.get_width(),font.get_width());
  screen.clear_screen();
- space.resize_image(screen.get_frame_width(),screen.get_frame_height());
+ space.resize_image(screen.get_frame_width(),screen.get_frame_height(),BILINEAR_FILTER);
  space.set_kind(NORMAL_BACKGROUND);
  mouse.hide();
  timer.set_timer(1);
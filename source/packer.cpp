@@ -0,0 +1,35 @@
+#include "blackgdk.h"
+
+const char *get_name(const char *file)
+{
+ const char *result;
+ result=file;
+ while (*file!=0)
+ {
+  if ((*file=='/')||(*file=='\\')) result=file+1;
+  ++file;
+ }
+ return result;
+}
+
+int main(int argc,char *argv[])
+{
+ int index,result;
+ BLACKGDK::Pack_Builder builder;
+ result=EXIT_SUCCESS;
+ if (argc<3)
+ {
+  puts("Usage: packer archive.pak image.tga image.pcx ...");
+  result=EXIT_FAILURE;
+ }
+ else
+ {
+  for (index=2;index<argc;++index)
+  {
+   builder.add_image(get_name(argv[index]),argv[index],BLACKGDK::get_image_format(argv[index]));
+  }
+  builder.save(argv[1]);
+  printf("%lu images packed to %s\n",static_cast<unsigned long int>(builder.get_amount()),argv[1]);
+ }
+ return result;
+}